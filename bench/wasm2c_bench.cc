@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <popl.hpp>
+
+#include "wasm2c.h"
+#include "wasm_module_writer.h"
+
+// many small functions calling their neighbour, like the glue code of a
+// big emscripten module
+std::vector<uint8_t> GenerateTinyFunctions(size_t scale, std::mt19937 &random)
+{
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+
+    for (size_t i = 0; i < 20000 * scale; i++)
+    {
+        std::vector<uint8_t> code;
+        WriteIndexed(code, 0x20, 0);
+        WriteI32Const(code, int32_t(random() % 100000));
+        code.push_back(0x6a);
+        if (i != 0 && i % 2 == 1)
+        {
+            WriteIndexed(code, 0x20, 0);
+            WriteIndexed(code, 0x10, uint32_t(i - 1));
+            code.push_back(0x6a);
+        }
+        module.Export(module.AddFunction(type, 0, code));
+    }
+
+    return module.Finish();
+}
+// a few functions of straight line arithmetic, memory accesses and ifs
+std::vector<uint8_t> GenerateHugeFunctions(size_t scale, std::mt19937 &random)
+{
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+    module.SetMemory(1);
+
+    for (size_t function = 0; function < 4; function++)
+    {
+        std::vector<uint8_t> code;
+        for (size_t statement = 0; statement < 100000 * scale; statement++)
+        {
+            int32_t constant = int32_t(random() % 65536);
+            switch (random() % 4)
+            {
+            case 0:
+                WriteIndexed(code, 0x20, 1);
+                WriteIndexed(code, 0x20, 0);
+                WriteI32Const(code, constant);
+                code.push_back(0x6c);
+                code.push_back(0x6a);
+                WriteIndexed(code, 0x21, 1);
+                break;
+            case 1:
+                WriteI32Const(code, constant & ~3);
+                WriteIndexed(code, 0x20, 1);
+                code.insert(code.end(), {0x36, 0x02, 0x00});
+                break;
+            case 2:
+                WriteIndexed(code, 0x20, 2);
+                WriteI32Const(code, constant & ~3);
+                code.insert(code.end(), {0x28, 0x02, 0x00});
+                code.push_back(0x73);
+                WriteIndexed(code, 0x21, 2);
+                break;
+            case 3:
+                WriteIndexed(code, 0x20, 0);
+                code.insert(code.end(), {0x04, 0x40});
+                WriteIndexed(code, 0x20, 1);
+                WriteI32Const(code, constant);
+                code.push_back(0x6b);
+                WriteIndexed(code, 0x21, 1);
+                code.push_back(0x0b);
+                break;
+            }
+        }
+        WriteIndexed(code, 0x20, 1);
+        WriteIndexed(code, 0x20, 2);
+        code.push_back(0x6a);
+        module.Export(module.AddFunction(type, 2, code));
+    }
+
+    return module.Finish();
+}
+// one function nesting blocks and one nesting additions thousands deep
+std::vector<uint8_t> GenerateDeepNesting(size_t scale, std::mt19937 &random)
+{
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+
+    std::vector<uint8_t> blocks;
+    for (size_t i = 0; i < 1000 * scale; i++)
+    {
+        // a br_if to one of the enclosing blocks
+        blocks.insert(blocks.end(), {0x02, 0x40});
+        WriteIndexed(blocks, 0x20, 0);
+        WriteIndexed(blocks, 0x0d, uint32_t(std::min<size_t>(i, i % 8)));
+    }
+    for (size_t i = 0; i < 1000 * scale; i++)
+        blocks.push_back(0x0b);
+    WriteIndexed(blocks, 0x20, 0);
+    module.Export(module.AddFunction(type, 0, blocks));
+
+    std::vector<uint8_t> additions;
+    size_t depth = 20000 * scale;
+    for (size_t i = 0; i < depth; i++)
+        WriteI32Const(additions, int32_t(random() % 1000));
+    for (size_t i = 1; i < depth; i++)
+        additions.push_back(0x6a);
+    module.Export(module.AddFunction(type, 0, additions));
+
+    return module.Finish();
+}
+// megabytes of active data segments and a function reading them
+std::vector<uint8_t> GenerateLargeData(size_t scale, std::mt19937 &random)
+{
+    constexpr uint32_t segmentSize = 64 << 10;
+
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+
+    size_t segments = 128 * scale;
+    module.SetMemory(uint32_t(segments + 1));
+    for (size_t segment = 0; segment < segments; segment++)
+    {
+        std::vector<uint8_t> bytes(segmentSize);
+        for (uint8_t &byte : bytes)
+            byte = uint8_t(random());
+        module.AddData(uint32_t(segment * segmentSize), std::move(bytes));
+    }
+
+    std::vector<uint8_t> code;
+    WriteIndexed(code, 0x20, 0);
+    code.insert(code.end(), {0x28, 0x02, 0x00});
+    module.Export(module.AddFunction(type, 0, code));
+
+    return module.Finish();
+}
+// decompiles a small module with the bench options and checks the C and
+// the data hold what they must, so a build writing wrong output does not
+// report its speed
+bool CheckBenchOutput(const Wasm2cOptions &options)
+{
+    static const std::string_view segment = "wasm2c_bench";
+
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+    module.SetMemory(1);
+    module.AddData(16, std::vector<uint8_t>(segment.begin(), segment.end()));
+
+    std::vector<uint8_t> code;
+    WriteIndexed(code, 0x20, 0);
+    WriteI32Const(code, 7);
+    code.push_back(0x6a);
+    module.Export(module.AddFunction(type, 0, code));
+    std::vector<uint8_t> binary = module.Finish();
+
+    std::string output;
+    std::string data;
+    Wasm2cCallbacks callbacks;
+    callbacks.output = [&output](std::string_view text) { output += text; };
+    callbacks.data = [&data](std::string_view text) { data += text; };
+    if (!DecompileWasm2c(std::vector<char>(binary.begin(), binary.end()), "wasm2c_bench.c", options, callbacks))
+        return false;
+
+    if (output.find("return v0 + 7;") == std::string::npos)
+    {
+        std::cout << "the decompiled C is wrong:\n" << output << std::endl;
+        return false;
+    }
+    if (data.find(segment) == std::string::npos)
+    {
+        std::cout << "the data file misses the data segment" << std::endl;
+        return false;
+    }
+    return true;
+}
+struct BenchResult
+{
+    std::string name;
+    size_t inputSize = 0;
+    size_t functions = 0;
+    size_t outputSize = 0;
+    double parseSeconds = std::numeric_limits<double>::infinity();
+    double emitSeconds = std::numeric_limits<double>::infinity();
+};
+// decompiles the binary `repetitions` times and keeps the fastest parse
+// and emit, which vary the least between runs. the C is written to
+// outputFile, so writing it is part of the emit time
+bool RunBench(BenchResult &result, const std::vector<char> &binary, const std::string &outputFile, const Wasm2cOptions &options, size_t repetitions)
+{
+    for (size_t repetition = 0; repetition < repetitions; repetition++)
+    {
+        DecompileStats stats;
+        if (!DecompileWasm2c(binary, outputFile, options, {}, &stats))
+            return false;
+
+        result.inputSize = binary.size();
+        result.functions = stats.functions.size();
+        result.outputSize = 0;
+        for (const DecompileStats::Function &function : stats.functions)
+            result.outputSize += function.bytes;
+        result.parseSeconds = std::min(result.parseSeconds, stats.WallSeconds("parse"));
+        result.emitSeconds = std::min(result.emitSeconds, stats.WallSeconds("plan") + stats.WallSeconds("emit"));
+    }
+    return true;
+}
+void PrintBenchResults(const std::vector<BenchResult> &results)
+{
+    constexpr double megabyte = 1 << 20;
+
+    char line[512];
+    std::snprintf(line, sizeof(line), "\n%-20s %10s %10s %12s %12s %12s %7s\n", "module", "size", "functions", "parse MB/s", "emit MB/s", "functions/s", "C MB/s");
+    std::cout << line;
+    for (const BenchResult &result : results)
+    {
+        std::snprintf(line, sizeof(line), "%-20s %9.2fM %10zu %12.1f %12.1f %12.0f %7.1f\n", result.name.c_str(), result.inputSize / megabyte, result.functions,
+                      result.inputSize / megabyte / result.parseSeconds, result.inputSize / megabyte / result.emitSeconds, result.functions / result.emitSeconds, result.outputSize / megabyte / result.emitSeconds);
+        std::cout << line;
+    }
+}
+int32_t main(int32_t argumentCount, char **argumentValues)
+{
+    popl::OptionParser commandLineParser("wasm2c_bench");
+
+    std::shared_ptr<popl::Value<size_t>> repetitionsOption = commandLineParser.add<popl::Value<size_t>>("r", "repetitions", "how often every module is decompiled, the fastest run counts", 3);
+    std::shared_ptr<popl::Value<size_t>> scaleOption = commandLineParser.add<popl::Value<size_t>>("s", "scale", "multiplies the size of the synthetic modules", 1);
+    std::shared_ptr<popl::Value<size_t>> jobsOption = commandLineParser.add<popl::Value<size_t>>("j", "jobs", "number of threads emitting function bodies, 0 for one per core", 1);
+    std::shared_ptr<popl::Value<std::string>> exampleOption = commandLineParser.add<popl::Value<std::string>>("", "example", "a real module to run after the synthetic ones", WASM2C_SOURCE_DIR "/example/diep/wasm.wasm");
+
+    commandLineParser.parse(argumentCount, argumentValues);
+
+    size_t scale = std::max<size_t>(scaleOption->value(), 1);
+    size_t repetitions = std::max<size_t>(repetitionsOption->value(), 1);
+
+    // every function is emitted, so the numbers do not depend on what the
+    // exports reach. the memory runtime and data file are part of the work
+    Wasm2cOptions options;
+    options.jobs = jobsOption->value();
+    options.keepUnreachable = true;
+    options.memoryMode = MemoryMode::Bounds;
+    options.dataMode = DataMode::File;
+    options.stats = true;
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "wasm2c_bench";
+    std::filesystem::create_directories(directory);
+
+    const std::pair<const char *, std::function<std::vector<uint8_t>(size_t, std::mt19937 &)>> generators[] = {
+        {"tiny-functions", GenerateTinyFunctions},
+        {"huge-functions", GenerateHugeFunctions},
+        {"deep-nesting", GenerateDeepNesting},
+        {"large-data", GenerateLargeData},
+    };
+
+    if (!CheckBenchOutput(options))
+        return 1;
+
+    std::vector<BenchResult> results;
+    bool succeeded = true;
+    for (const auto &[name, generate] : generators)
+    {
+        // the same seed every run, so runs compare the same modules
+        std::mt19937 random(1);
+        std::vector<uint8_t> binary = generate(scale, random);
+
+        BenchResult result;
+        result.name = name;
+        if (RunBench(result, std::vector<char>(binary.begin(), binary.end()), (directory / (std::string(name) + ".c")).string(), options, repetitions))
+            results.push_back(result);
+        else
+            succeeded = false;
+    }
+
+    const std::string &example = exampleOption->value();
+    std::ifstream exampleStream(example, std::ios::binary);
+    if (exampleStream.is_open())
+    {
+        std::vector<char> binary((std::istreambuf_iterator<char>(exampleStream)), std::istreambuf_iterator<char>());
+
+        BenchResult result;
+        result.name = std::filesystem::path(example).parent_path().filename().string();
+        if (RunBench(result, binary, (directory / (result.name + ".c")).string(), options, repetitions))
+            results.push_back(result);
+        else
+            succeeded = false;
+    }
+    else
+        std::cout << "skipping the example, " << example << " cannot be read" << std::endl;
+
+    PrintBenchResults(results);
+
+    return succeeded ? 0 : 1;
+}
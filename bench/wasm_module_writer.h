@@ -0,0 +1,178 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// encodes the wasm binaries of the synthetic modules of the benchmark and
+// the tests. only what they need: functions of a single value type, one
+// memory, exports and active data
+class WasmModuleWriter
+{
+public:
+    // the params and the result are all of valueType, i32 by default.
+    // returns the type index
+    uint32_t AddType(uint32_t params, bool result, uint8_t valueType = 0x7f)
+    {
+        std::vector<uint8_t> type = {0x60};
+        WriteLEB(type, params);
+        type.insert(type.end(), params, valueType);
+        WriteLEB(type, result ? 1 : 0);
+        if (result)
+            type.push_back(valueType);
+        types.push_back(std::move(type));
+        return uint32_t(types.size() - 1);
+    }
+    // the body is the code after the locals, without the final end.
+    // returns the function index
+    uint32_t AddFunction(uint32_t type, uint32_t locals, const std::vector<uint8_t> &code)
+    {
+        std::vector<uint8_t> body;
+        if (locals == 0)
+            WriteLEB(body, 0);
+        else
+        {
+            WriteLEB(body, 1);
+            WriteLEB(body, locals);
+            body.push_back(0x7f);
+        }
+        body.insert(body.end(), code.begin(), code.end());
+        body.push_back(0x0b);
+
+        functionTypes.push_back(type);
+        bodies.push_back(std::move(body));
+        return uint32_t(bodies.size() - 1);
+    }
+    void Export(uint32_t function)
+    {
+        exports.push_back(function);
+    }
+    void SetMemory(uint32_t pages)
+    {
+        memoryPages = pages;
+    }
+    void AddData(uint32_t offset, std::vector<uint8_t> bytes)
+    {
+        data.push_back({offset, std::move(bytes)});
+    }
+    size_t FunctionCount() const
+    {
+        return bodies.size();
+    }
+
+    std::vector<uint8_t> Finish() const
+    {
+        std::vector<uint8_t> binary = {0x00, 'a', 's', 'm', 0x01, 0x00, 0x00, 0x00};
+
+        WriteSection(binary, 1, types);
+
+        std::vector<uint8_t> functions;
+        WriteLEB(functions, functionTypes.size());
+        for (uint32_t type : functionTypes)
+            WriteLEB(functions, type);
+        WriteSection(binary, 3, functions);
+
+        if (memoryPages != 0)
+        {
+            std::vector<uint8_t> memory = {0x01, 0x00};
+            WriteLEB(memory, memoryPages);
+            WriteSection(binary, 5, memory);
+        }
+
+        std::vector<std::vector<uint8_t>> exportEntries;
+        for (uint32_t function : exports)
+        {
+            std::string name = "f" + std::to_string(function);
+            std::vector<uint8_t> entry;
+            WriteLEB(entry, name.size());
+            entry.insert(entry.end(), name.begin(), name.end());
+            entry.push_back(0x00);
+            WriteLEB(entry, function);
+            exportEntries.push_back(std::move(entry));
+        }
+        WriteSection(binary, 7, exportEntries);
+
+        std::vector<std::vector<uint8_t>> sizedBodies;
+        for (const std::vector<uint8_t> &body : bodies)
+        {
+            std::vector<uint8_t> sized;
+            WriteLEB(sized, body.size());
+            sized.insert(sized.end(), body.begin(), body.end());
+            sizedBodies.push_back(std::move(sized));
+        }
+        WriteSection(binary, 10, sizedBodies);
+
+        std::vector<std::vector<uint8_t>> segments;
+        for (const auto &[offset, bytes] : data)
+        {
+            std::vector<uint8_t> segment = {0x00, 0x41};
+            WriteSLEB(segment, offset);
+            segment.push_back(0x0b);
+            WriteLEB(segment, bytes.size());
+            segment.insert(segment.end(), bytes.begin(), bytes.end());
+            segments.push_back(std::move(segment));
+        }
+        if (!segments.empty())
+            WriteSection(binary, 11, segments);
+
+        return binary;
+    }
+
+    static void WriteLEB(std::vector<uint8_t> &output, uint64_t value)
+    {
+        do
+        {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            output.push_back(value != 0 ? byte | 0x80 : byte);
+        } while (value != 0);
+    }
+    static void WriteSLEB(std::vector<uint8_t> &output, int64_t value)
+    {
+        while (true)
+        {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)))
+            {
+                output.push_back(byte);
+                return;
+            }
+            output.push_back(byte | 0x80);
+        }
+    }
+
+private:
+    static void WriteSection(std::vector<uint8_t> &binary, uint8_t id, const std::vector<uint8_t> &content)
+    {
+        binary.push_back(id);
+        WriteLEB(binary, content.size());
+        binary.insert(binary.end(), content.begin(), content.end());
+    }
+    static void WriteSection(std::vector<uint8_t> &binary, uint8_t id, const std::vector<std::vector<uint8_t>> &entries)
+    {
+        std::vector<uint8_t> content;
+        WriteLEB(content, entries.size());
+        for (const std::vector<uint8_t> &entry : entries)
+            content.insert(content.end(), entry.begin(), entry.end());
+        WriteSection(binary, id, content);
+    }
+
+    std::vector<std::vector<uint8_t>> types;
+    std::vector<uint32_t> functionTypes;
+    std::vector<std::vector<uint8_t>> bodies;
+    std::vector<uint32_t> exports;
+    uint32_t memoryPages = 0;
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> data;
+};
+inline void WriteI32Const(std::vector<uint8_t> &code, int32_t value)
+{
+    code.push_back(0x41);
+    WasmModuleWriter::WriteSLEB(code, value);
+}
+// an instruction with one index immediate: local.get, call, br_if and so on
+inline void WriteIndexed(std::vector<uint8_t> &code, uint8_t opcode, uint32_t index)
+{
+    code.push_back(opcode);
+    WasmModuleWriter::WriteLEB(code, index);
+}
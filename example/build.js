@@ -1,16 +1,11 @@
 const { spawnSync: spawn } = require("child_process")
 const { readdirSync: readdir, lstatSync: lstat} = require("fs")
 
-const files = readdir("./")
+const directories = readdir("./").filter(directory => lstat(directory).isDirectory())
 
-files.forEach((directory) =>
-{
-    if (!lstat(directory).isDirectory())
-        return
-    
-    const files = readdir(directory)
+const inputs = []
+directories.forEach(directory => inputs.push("-i", directory))
 
-    files.forEach(file =>
-        spawn("../build/wasm2c", ["-i", directory + "/" + file, "-o", directory + "/" + file + ".c"])
-    )
-})
+// one wasm2c process decompiles every example, writing each file.wasm.c
+// next to its input
+spawn("../build/wasm2c", [...inputs, "-j", "0"], { stdio: "inherit" })
@@ -1,1037 +1,526 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
-#include <popl.hpp>
-
-#include <wasm-binary.h>
-#include <wasm-features.h>
-
-std::string indentation = "";
-
-size_t expressionDepth = 0;
+#include <sys/resource.h>
 
-wasm::Module *ParseWasm(const std::vector<char> &binaryData)
-{
-    wasm::Module *module = new wasm::Module;
-    wasm::WasmBinaryBuilder parser(*module, FeatureSet::MVP, binaryData);
-    parser.read();
+#include <popl.hpp>
 
-    return module;
-}
-std::string GetStringFromWasmType(wasm::Type &type)
-{
-    switch (type.getBasic())
-    {
-    case wasm::Type::BasicType::i32:
-        return "int32_t";
-    case wasm::Type::BasicType::f32:
-        return "float";
-    case wasm::Type::BasicType::f64:
-        return "double";
-    case wasm::Type::BasicType::i64:
-        return "int64_t";
-    case wasm::Type::BasicType::none:
-        return "void";
-    default:
-        std::cout << "cannot convert type " << std::to_string(type.getBasic()) << " to string" << std::endl;
+#include "wasm2c.h"
 
-        return std::string("#") + std::to_string(type.getBasic());
-    }
-}
-std::string GetFunctionSignature(wasm::Function *function)
+// reads a stream of unknown length (stdin, pipes) in large chunks
+std::vector<char> ReadDataFromStream(std::istream &stream)
 {
-    std::string output;
-
-    wasm::Signature signature = function->getSig();
-    output += GetStringFromWasmType(signature.results) + " func" + function->name.str + "(";
+    std::vector<char> data;
+    size_t chunkSize = 1 << 20;
 
-    size_t index = 0;
-    for (auto i = signature.params.begin(); i != signature.params.end(); i++)
+    while (stream)
     {
-        wasm::Type parameterType = signature.params[index];
-        output += GetStringFromWasmType(parameterType) + " v" + std::to_string(index);
-        if (i != signature.params.end() - 1)
-            output += ", ";
-        index++;
+        size_t size = data.size();
+        data.resize(size + chunkSize);
+        stream.read(data.data() + size, chunkSize);
+        data.resize(size + stream.gcount());
+        chunkSize = std::min<size_t>(chunkSize * 2, 64 << 20);
     }
-    output += ")";
 
-    return output;
+    return data;
 }
-void GetWasm2cExperssion(std::string &output, wasm::Expression *expression, size_t depth)
+// the binary reader takes a std::vector, so the file is read straight into
+// a vector of the right size with a single read instead of growing it a
+// byte at a time. "-" reads from stdin
+std::vector<char> ReadDataFromFilePath(const std::string &path)
 {
-    wasm::Expression::Id id = expression->_id;
-    switch (id)
-    {
-    case wasm::Expression::CallId:
-    {
-        wasm::Call *functionCall = static_cast<wasm::Call *>(expression);
-        if (expressionDepth == 0)
-            output += indentation;
-        output += "func";
-        output += functionCall->target.str;
-        output += "(";
-        expressionDepth++;
-        size_t i = 0;
-        for (wasm::Expression *operand : functionCall->operands)
-        {
-            GetWasm2cExperssion(output, operand, depth + 1);
-            if (i != functionCall->operands.size() - 1)
-                output += ", ";
-            else if (operand->_id == wasm::Expression::IfId)
-                output += indentation;
-            i++;
-        }
-        output += ")";
-        expressionDepth--;
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
-    }
-    case wasm::Expression::BlockId:
-    {
-        wasm::Block *block = static_cast<wasm::Block *>(expression);
-        if (block == nullptr)
-            return;
-        if (expressionDepth != 0)
-            indentation += "    ";
-        else
-            output += indentation;
-        if (block->name.str != nullptr)
-            output += std::string(block->name.str) + ":\n" + indentation;
-        output += "{\n";
-        indentation += "    ";
-        size_t _expressionDepth = expressionDepth;
-        expressionDepth = 0;
-        for (wasm::Expression *expression : block->list)
-            GetWasm2cExperssion(output, expression, depth + 1);
-        expressionDepth = _expressionDepth;
-        indentation = indentation.substr(4);
-        output += indentation + "}";
-        if (expressionDepth != 0)
-        {
-            indentation = indentation.substr(4);
-            output += "\n" + indentation;
-        }
-        else
-            output += "\n";
-        return;
-    }
-    case wasm::Expression::LocalGetId:
-    {
-        wasm::LocalGet *localGetExpression = static_cast<wasm::LocalGet *>(expression);
+    std::vector<char> fileData;
 
-        if (expressionDepth != 0)
-            output += "v" + std::to_string(localGetExpression->index);
-        else
-            output += indentation + "return v" + std::to_string(localGetExpression->index) + ";\n";
-        return;
+    if (path == "-")
+    {
+        std::ios::sync_with_stdio(false);
+        fileData = ReadDataFromStream(std::cin);
     }
-    case wasm::Expression::LoadId:
+    else
     {
-        wasm::Load *loadInstruction = static_cast<wasm::Load *>(expression);
-
-        if (expressionDepth == 0)
-            output += indentation + "return ";
-
-        if (loadInstruction->bytes == 1)
-        {
-            output += "u8[";
-            expressionDepth++;
-            GetWasm2cExperssion(output, loadInstruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(loadInstruction->offset) + "]";
-        }
-        else if (loadInstruction->bytes == 2)
+        std::ifstream fileStream(path, std::ios::binary | std::ios::ate);
+        if (!fileStream.is_open())
         {
-
-            output += "u16[(";
-            expressionDepth++;
-            GetWasm2cExperssion(output, loadInstruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(loadInstruction->offset) + ") >> 1]";
+            std::cout << "could not open file path " << path << std::endl;
+            throw std::runtime_error("unable to open file");
         }
-        else if (loadInstruction->bytes == 4)
-        {
 
-            output += "u32[(";
-            expressionDepth++;
-            GetWasm2cExperssion(output, loadInstruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(loadInstruction->offset) + ") >> 2]";
-        }
-        else if (loadInstruction->bytes == 8)
+        std::streamoff size = fileStream.tellg();
+        if (size < 0 || !fileStream.seekg(0))
         {
-            output += "u64[(";
-            expressionDepth++;
-            GetWasm2cExperssion(output, loadInstruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(loadInstruction->offset) + ") >> 3]";
+            // not seekable (a fifo or character device), read it as a stream
+            fileStream.clear();
+            fileData = ReadDataFromStream(fileStream);
         }
         else
         {
-            std::cout << "load with " << std::to_string(loadInstruction->bytes) << " not supported" << std::endl;
-            output += "unimplementedload" + std::to_string(loadInstruction->bytes);
+            fileData.resize(size);
+            if (!fileStream.read(fileData.data(), size))
+            {
+                std::cout << "could not read file path " << path << std::endl;
+                throw std::runtime_error("unable to read file");
+            }
         }
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
     }
-    case wasm::Expression::LocalSetId:
-    {
-        wasm::LocalSet *setInstruction = static_cast<wasm::LocalSet *>(expression);
 
-        if (expressionDepth == 0)
-            output += indentation;
-        output += "v" + std::to_string(setInstruction->index) + " = ";
-        if (setInstruction->value->_id == wasm::Expression::IfId)
-        {
-            indentation += "    ";
-            output += "(";
-        }
-        expressionDepth++;
-        GetWasm2cExperssion(output, setInstruction->value, depth + 1);
-        expressionDepth--;
+    std::cout << "read file of " << fileData.size() << " size" << std::endl;
+    return fileData;
+}
+struct DecompileJob
+{
+    std::string inputFile;
+    std::string outputFile;
+    size_t inputSize = 0;
+    bool succeeded = false;
+    DecompileStats stats;
+};
+// the peak resident set size of the whole process
+size_t GetPeakResidentBytes()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
 
-        if (setInstruction->value->_id == wasm::Expression::IfId)
-        {
-            indentation = indentation.substr(4);
-            output += indentation + ")";
-        }
-        if (expressionDepth == 0)
-        {
-            if (setInstruction->value->_id != wasm::Expression::BlockId)
-                output += ';';
-            output += '\n';
-        }
-        return;
-    }
-    case wasm::Expression::BreakId:
-    {
-        wasm::Break *breakInstruction = static_cast<wasm::Break *>(expression);
+    // in KiB on linux
+    return size_t(usage.ru_maxrss) * 1024;
+}
+// the --stats report of one file: the phases, the emitted functions and the
+// slowest and largest of them. written in one piece so the reports of a
+// batch do not interleave
+void PrintDecompileStats(const DecompileJob &job)
+{
+    constexpr size_t topFunctions = 10;
 
-        std::string label = breakInstruction->name.str != nullptr ? breakInstruction->name.str : "";
+    const DecompileStats &stats = job.stats;
+    std::ostringstream report;
+    char line[512];
 
-        if (breakInstruction->condition != nullptr)
-        {
-            if (expressionDepth == 0)
-                output += indentation;
+    report << "stats for " << job.inputFile << "\n";
+    std::snprintf(line, sizeof(line), "  %-12s %10s %10s\n", "phase", "wall", "cpu");
+    report << line;
+    for (const DecompileStats::Phase &phase : stats.phases)
+    {
+        std::snprintf(line, sizeof(line), "  %-12s %9.3fs %9.3fs\n", phase.name, phase.wallSeconds, phase.cpuSeconds);
+        report << line;
+    }
 
-            output += "if (";
-            expressionDepth++;
-            GetWasm2cExperssion(output, breakInstruction->condition, depth + 1);
-            expressionDepth--;
-            output += ")\n";
-            indentation += "    ";
-        }
-        output += indentation + "break";
-        if (breakInstruction->condition != nullptr)
-            indentation = indentation.substr(4);
-        if (breakInstruction->value != nullptr)
+    double totalSeconds = 0;
+    size_t totalBytes = 0;
+    size_t inlinedFunctions = 0;
+    size_t inlinedBytes = 0;
+    for (const DecompileStats::Function &function : stats.functions)
+    {
+        totalSeconds += function.seconds;
+        totalBytes += function.bytes;
+        if (function.inlined)
         {
-            output += " (";
-            expressionDepth++;
-            GetWasm2cExperssion(output, breakInstruction->value, depth + 1);
-            expressionDepth--;
-            output += ")";
+            inlinedFunctions++;
+            inlinedBytes += function.bytes;
         }
-        output += ";\n";
-        return;
     }
-    case wasm::Expression::UnaryId:
+    report << "  " << stats.functions.size() << " functions emitted in " << totalSeconds << "s of thread time, " << totalBytes << " bytes of C\n";
+    if (inlinedFunctions != 0)
+        report << "  " << inlinedFunctions << " of them static inline (" << inlinedBytes << " bytes of C), called from " << stats.inlinedCallSites << " call sites\n";
+
+    auto printTop = [&](const char *title, const std::function<bool(const DecompileStats::Function *, const DecompileStats::Function *)> &before)
     {
-        wasm::Unary *unaryInstruction = static_cast<wasm::Unary *>(expression);
-#define APPEND_TO_OUTPUT(x)                                              \
-    case wasm::x:                                                        \
-        output += std::string("__" #x) + "(";                            \
-        expressionDepth++;                                               \
-        GetWasm2cExperssion(output, unaryInstruction->value, depth + 1); \
-        expressionDepth--;                                               \
-        output += ")";                                                   \
-        break;
+        std::vector<const DecompileStats::Function *> top;
+        for (const DecompileStats::Function &function : stats.functions)
+            top.push_back(&function);
+        size_t count = std::min(top.size(), topFunctions);
+        std::partial_sort(top.begin(), top.begin() + count, top.end(), before);
 
-        switch (unaryInstruction->op)
+        report << "  " << title << "\n";
+        for (size_t i = 0; i < count; i++)
         {
-            APPEND_TO_OUTPUT(ClzInt32)
-            APPEND_TO_OUTPUT(ClzInt64)
-            APPEND_TO_OUTPUT(CtzInt32)
-            APPEND_TO_OUTPUT(CtzInt64)
-            APPEND_TO_OUTPUT(PopcntInt32)
-            APPEND_TO_OUTPUT(PopcntInt64)
-            APPEND_TO_OUTPUT(NegFloat32)
-            APPEND_TO_OUTPUT(NegFloat64)
-            APPEND_TO_OUTPUT(AbsFloat32)
-            APPEND_TO_OUTPUT(AbsFloat64)
-            APPEND_TO_OUTPUT(CeilFloat32)
-            APPEND_TO_OUTPUT(CeilFloat64)
-            APPEND_TO_OUTPUT(FloorFloat32)
-            APPEND_TO_OUTPUT(FloorFloat64)
-            APPEND_TO_OUTPUT(TruncFloat32)
-            APPEND_TO_OUTPUT(TruncFloat64)
-            APPEND_TO_OUTPUT(NearestFloat32)
-            APPEND_TO_OUTPUT(NearestFloat64)
-            APPEND_TO_OUTPUT(SqrtFloat32)
-            APPEND_TO_OUTPUT(SqrtFloat64)
-            APPEND_TO_OUTPUT(EqZInt32)
-            APPEND_TO_OUTPUT(EqZInt64)
-            APPEND_TO_OUTPUT(ExtendSInt32)
-            APPEND_TO_OUTPUT(ExtendUInt32)
-            APPEND_TO_OUTPUT(WrapInt64)
-            APPEND_TO_OUTPUT(TruncSFloat32ToInt32)
-            APPEND_TO_OUTPUT(TruncSFloat32ToInt64)
-            APPEND_TO_OUTPUT(TruncUFloat32ToInt32)
-            APPEND_TO_OUTPUT(TruncUFloat32ToInt64)
-            APPEND_TO_OUTPUT(TruncSFloat64ToInt32)
-            APPEND_TO_OUTPUT(TruncSFloat64ToInt64)
-            APPEND_TO_OUTPUT(TruncUFloat64ToInt32)
-            APPEND_TO_OUTPUT(TruncUFloat64ToInt64)
-            APPEND_TO_OUTPUT(ReinterpretFloat32)
-            APPEND_TO_OUTPUT(ReinterpretFloat64)
-            APPEND_TO_OUTPUT(ConvertSInt32ToFloat32)
-            APPEND_TO_OUTPUT(ConvertSInt32ToFloat64)
-            APPEND_TO_OUTPUT(ConvertUInt32ToFloat32)
-            APPEND_TO_OUTPUT(ConvertUInt32ToFloat64)
-            APPEND_TO_OUTPUT(ConvertSInt64ToFloat32)
-            APPEND_TO_OUTPUT(ConvertSInt64ToFloat64)
-            APPEND_TO_OUTPUT(ConvertUInt64ToFloat32)
-            APPEND_TO_OUTPUT(ConvertUInt64ToFloat64)
-            APPEND_TO_OUTPUT(PromoteFloat32)
-            APPEND_TO_OUTPUT(DemoteFloat64)
-            APPEND_TO_OUTPUT(ReinterpretInt32)
-            APPEND_TO_OUTPUT(ReinterpretInt64)
-            APPEND_TO_OUTPUT(ExtendS8Int32)
-            APPEND_TO_OUTPUT(ExtendS16Int32)
-            APPEND_TO_OUTPUT(ExtendS8Int64)
-            APPEND_TO_OUTPUT(ExtendS16Int64)
-            APPEND_TO_OUTPUT(ExtendS32Int64)
-            APPEND_TO_OUTPUT(TruncSatSFloat32ToInt32)
-            APPEND_TO_OUTPUT(TruncSatUFloat32ToInt32)
-            APPEND_TO_OUTPUT(TruncSatSFloat64ToInt32)
-            APPEND_TO_OUTPUT(TruncSatUFloat64ToInt32)
-            APPEND_TO_OUTPUT(TruncSatSFloat32ToInt64)
-            APPEND_TO_OUTPUT(TruncSatUFloat32ToInt64)
-            APPEND_TO_OUTPUT(TruncSatSFloat64ToInt64)
-            APPEND_TO_OUTPUT(TruncSatUFloat64ToInt64)
-            APPEND_TO_OUTPUT(SplatVecI8x16)
-            APPEND_TO_OUTPUT(SplatVecI16x8)
-            APPEND_TO_OUTPUT(SplatVecI32x4)
-            APPEND_TO_OUTPUT(SplatVecI64x2)
-            APPEND_TO_OUTPUT(SplatVecF32x4)
-            APPEND_TO_OUTPUT(SplatVecF64x2)
-            APPEND_TO_OUTPUT(NotVec128)
-            APPEND_TO_OUTPUT(AnyTrueVec128)
-            APPEND_TO_OUTPUT(AbsVecI8x16)
-            APPEND_TO_OUTPUT(NegVecI8x16)
-            APPEND_TO_OUTPUT(AllTrueVecI8x16)
-            APPEND_TO_OUTPUT(BitmaskVecI8x16)
-            APPEND_TO_OUTPUT(PopcntVecI8x16)
-            APPEND_TO_OUTPUT(AbsVecI16x8)
-            APPEND_TO_OUTPUT(NegVecI16x8)
-            APPEND_TO_OUTPUT(AllTrueVecI16x8)
-            APPEND_TO_OUTPUT(BitmaskVecI16x8)
-            APPEND_TO_OUTPUT(AbsVecI32x4)
-            APPEND_TO_OUTPUT(NegVecI32x4)
-            APPEND_TO_OUTPUT(AllTrueVecI32x4)
-            APPEND_TO_OUTPUT(BitmaskVecI32x4)
-            APPEND_TO_OUTPUT(AbsVecI64x2)
-            APPEND_TO_OUTPUT(NegVecI64x2)
-            APPEND_TO_OUTPUT(AllTrueVecI64x2)
-            APPEND_TO_OUTPUT(BitmaskVecI64x2)
-            APPEND_TO_OUTPUT(AbsVecF32x4)
-            APPEND_TO_OUTPUT(NegVecF32x4)
-            APPEND_TO_OUTPUT(SqrtVecF32x4)
-            APPEND_TO_OUTPUT(CeilVecF32x4)
-            APPEND_TO_OUTPUT(FloorVecF32x4)
-            APPEND_TO_OUTPUT(TruncVecF32x4)
-            APPEND_TO_OUTPUT(NearestVecF32x4)
-            APPEND_TO_OUTPUT(AbsVecF64x2)
-            APPEND_TO_OUTPUT(NegVecF64x2)
-            APPEND_TO_OUTPUT(SqrtVecF64x2)
-            APPEND_TO_OUTPUT(CeilVecF64x2)
-            APPEND_TO_OUTPUT(FloorVecF64x2)
-            APPEND_TO_OUTPUT(TruncVecF64x2)
-            APPEND_TO_OUTPUT(NearestVecF64x2)
-            APPEND_TO_OUTPUT(ExtAddPairwiseSVecI8x16ToI16x8)
-            APPEND_TO_OUTPUT(ExtAddPairwiseUVecI8x16ToI16x8)
-            APPEND_TO_OUTPUT(ExtAddPairwiseSVecI16x8ToI32x4)
-            APPEND_TO_OUTPUT(ExtAddPairwiseUVecI16x8ToI32x4)
-            APPEND_TO_OUTPUT(TruncSatSVecF32x4ToVecI32x4)
-            APPEND_TO_OUTPUT(TruncSatUVecF32x4ToVecI32x4)
-            APPEND_TO_OUTPUT(ConvertSVecI32x4ToVecF32x4)
-            APPEND_TO_OUTPUT(ConvertUVecI32x4ToVecF32x4)
-            APPEND_TO_OUTPUT(ExtendLowSVecI8x16ToVecI16x8)
-            APPEND_TO_OUTPUT(ExtendHighSVecI8x16ToVecI16x8)
-            APPEND_TO_OUTPUT(ExtendLowUVecI8x16ToVecI16x8)
-            APPEND_TO_OUTPUT(ExtendHighUVecI8x16ToVecI16x8)
-            APPEND_TO_OUTPUT(ExtendLowSVecI16x8ToVecI32x4)
-            APPEND_TO_OUTPUT(ExtendHighSVecI16x8ToVecI32x4)
-            APPEND_TO_OUTPUT(ExtendLowUVecI16x8ToVecI32x4)
-            APPEND_TO_OUTPUT(ExtendHighUVecI16x8ToVecI32x4)
-            APPEND_TO_OUTPUT(ExtendLowSVecI32x4ToVecI64x2)
-            APPEND_TO_OUTPUT(ExtendHighSVecI32x4ToVecI64x2)
-            APPEND_TO_OUTPUT(ExtendLowUVecI32x4ToVecI64x2)
-            APPEND_TO_OUTPUT(ExtendHighUVecI32x4ToVecI64x2)
-            APPEND_TO_OUTPUT(ConvertLowSVecI32x4ToVecF64x2)
-            APPEND_TO_OUTPUT(ConvertLowUVecI32x4ToVecF64x2)
-            APPEND_TO_OUTPUT(TruncSatZeroSVecF64x2ToVecI32x4)
-            APPEND_TO_OUTPUT(TruncSatZeroUVecF64x2ToVecI32x4)
-            APPEND_TO_OUTPUT(DemoteZeroVecF64x2ToVecF32x4)
-            APPEND_TO_OUTPUT(PromoteLowVecF32x4ToVecF64x2)
-            APPEND_TO_OUTPUT(RelaxedTruncSVecF32x4ToVecI32x4)
-            APPEND_TO_OUTPUT(RelaxedTruncUVecF32x4ToVecI32x4)
-            APPEND_TO_OUTPUT(RelaxedTruncZeroSVecF64x2ToVecI32x4)
-            APPEND_TO_OUTPUT(RelaxedTruncZeroUVecF64x2ToVecI32x4)
-            APPEND_TO_OUTPUT(InvalidUnary)
+            std::snprintf(line, sizeof(line), "    %9.6fs %10zu bytes  %s\n", top[i]->seconds, top[i]->bytes, top[i]->name.c_str());
+            report << line;
         }
-
-#undef APPEND_TO_OUTPUT
-        return;
-    }
-    case wasm::Expression::UnreachableId:
+    };
+    if (!stats.functions.empty())
     {
-        if (expressionDepth == 0)
-            output += indentation;
-        output += "assert(false)";
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
+        printTop("slowest functions", [](const DecompileStats::Function *left, const DecompileStats::Function *right)
+                 { return left->seconds > right->seconds; });
+        printTop("largest functions", [](const DecompileStats::Function *left, const DecompileStats::Function *right)
+                 { return left->bytes > right->bytes; });
     }
-    case wasm::Expression::BinaryId:
-    {
-        wasm::Binary *instruction = static_cast<wasm::Binary *>(expression);
-
-        if (expressionDepth == 0)
-            output += indentation + "return ";
-
-        bool grouped = instruction->left->_id == wasm::Expression::BinaryId || instruction->left->_id == wasm::Expression::UnaryId || instruction->left->_id == wasm::Expression::LocalSetId;
-        if (grouped)
-            output += "(";
-        
-        if (instruction->left->_id == wasm::Expression::IfId)
-        {
-            indentation += "    ";
-            output += "(";
-        }
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->left, depth + 1);
-        expressionDepth--;
-        if (instruction->left->_id == wasm::Expression::IfId)
-        {
-            indentation = indentation.substr(4);
-            output += indentation + ")";
-        }
-        if (grouped)
-            output += ")";
-
-        switch (instruction->op)
-        {
-        case wasm::AddInt32:
-        case wasm::AddInt64:
-        case wasm::AddFloat32:
-        case wasm::AddFloat64:
-            output += " + ";
-            break;
-        case wasm::SubInt32:
-        case wasm::SubInt64:
-        case wasm::SubFloat32:
-        case wasm::SubFloat64:
-            output += " - ";
-            break;
-        case wasm::MulInt32:
-        case wasm::MulInt64:
-        case wasm::MulFloat32:
-        case wasm::MulFloat64:
-            output += " * ";
-            break;
-        case wasm::DivSInt32:
-        case wasm::DivUInt32:
-        case wasm::DivSInt64:
-        case wasm::DivUInt64:
-        case wasm::DivFloat32:
-        case wasm::DivFloat64:
-            output += " / ";
-            break;
-        case wasm::RemSInt32:
-        case wasm::RemUInt32:
-        case wasm::RemSInt64:
-        case wasm::RemUInt64:
-            output += " % ";
-            break;
-        case wasm::AndInt32:
-        case wasm::AndInt64:
-            output += " & ";
-            break;
-        case wasm::OrInt32:
-        case wasm::OrInt64:
-            output += " | ";
-            break;
-        case wasm::XorInt32:
-        case wasm::XorInt64:
-            output += " ^ ";
-            break;
-        case wasm::ShlInt32:
-        case wasm::ShlInt64:
-            output += " << ";
-            break;
-        case wasm::ShrSInt32:
-        case wasm::ShrUInt32:
-        case wasm::ShrSInt64:
-        case wasm::ShrUInt64:
-            output += " >> ";
-            break;
-        case wasm::RotLInt32:
-        case wasm::RotLInt64:
-            output += " <<< ";
-            break;
-        case wasm::RotRInt32:
-        case wasm::RotRInt64:
-            output += " >>> ";
-            break;
-        case wasm::EqInt32:
-        case wasm::EqInt64:
-        case wasm::EqFloat32:
-        case wasm::EqFloat64:
-        case wasm::EqVecI8x16:
-            output += " == ";
-            break;
-        case wasm::NeInt32:
-        case wasm::NeInt64:
-        case wasm::NeFloat32:
-        case wasm::NeFloat64:
-        case wasm::NeVecI8x16:
-            output += " != ";
-            break;
-        case wasm::LtSInt32:
-        case wasm::LtUInt32:
-        case wasm::LtSInt64:
-        case wasm::LtUInt64:
-        case wasm::LtFloat32:
-        case wasm::LtFloat64:
-        case wasm::LtSVecI8x16:
-        case wasm::LtUVecI8x16:
-            output += " < ";
-            break;
-        case wasm::LeSInt32:
-        case wasm::LeUInt32:
-        case wasm::LeSInt64:
-        case wasm::LeUInt64:
-        case wasm::LeFloat32:
-        case wasm::LeFloat64:
-        case wasm::LeSVecI8x16:
-        case wasm::LeUVecI8x16:
-            output += " <= ";
-            break;
-        case wasm::GtSInt32:
-        case wasm::GtUInt32:
-        case wasm::GtSInt64:
-        case wasm::GtUInt64:
-        case wasm::GtFloat32:
-        case wasm::GtFloat64:
-        case wasm::GtSVecI8x16:
-        case wasm::GtUVecI8x16:
-            output += " > ";
-            break;
-        case wasm::GeSInt32:
-        case wasm::GeUInt32:
-        case wasm::GeSInt64:
-        case wasm::GeUInt64:
-        case wasm::GeFloat32:
-        case wasm::GeFloat64:
-        case wasm::GeSVecI8x16:
-        case wasm::GeUVecI8x16:
-            output += " >= ";
-            break;
-        case wasm::MinFloat32:
-        case wasm::MinFloat64:
-            output += " min ";
-            break;
-        case wasm::MaxFloat32:
-        case wasm::MaxFloat64:
-            output += " max";
-            break;
-        case wasm::CopySignFloat32:
-        case wasm::CopySignFloat64:
-            output += " CopySign ";
-            break;
-        default:
-            std::cout << "could not determine binary operator for #" << std::to_string(instruction->op) << std::endl;
-            output += " #" + std::to_string(instruction->op) + " ";
-        }
 
-        grouped = instruction->right->_id == wasm::Expression::BinaryId || instruction->right->_id == wasm::Expression::UnaryId || instruction->right->_id == wasm::Expression::LocalSetId;
-        if (grouped)
-            output += "(";
-        if (instruction->right->_id == wasm::Expression::IfId)
-        {
-            indentation += "    ";
-            output += "(";
-        }
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->right, depth + 1);
-        expressionDepth--;
-        if (instruction->right->_id == wasm::Expression::IfId)
-        {
-            indentation = indentation.substr(4);
-            output += indentation + ")";
-        }
-        if (grouped)
-            output += ")";
-
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
-    }
-    case wasm::Expression::StoreId:
+    report << "  peak resident memory " << GetPeakResidentBytes() / (1 << 20) << " MiB\n";
+    std::cout << report.str() << std::flush;
+}
+void WriteJsonString(std::ostream &output, std::string_view text)
+{
+    output << '"';
+    for (char character : text)
     {
-        wasm::Store *instruction = static_cast<wasm::Store *>(expression);
-
-        if (expressionDepth == 0)
-            output += indentation;
-
-        if (instruction->bytes == 1)
+        if (character == '"' || character == '\\')
+            output << '\\' << character;
+        else if (static_cast<unsigned char>(character) < 0x20)
         {
-            output += "u8[";
-            expressionDepth++;
-            GetWasm2cExperssion(output, instruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(instruction->offset) + "]";
-        }
-        else if (instruction->bytes == 2)
-        {
-
-            output += "u16[(";
-            expressionDepth++;
-            GetWasm2cExperssion(output, instruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(instruction->offset) + ") >> 1]";
-        }
-        else if (instruction->bytes == 4)
-        {
-
-            output += "u32[(";
-            expressionDepth++;
-            GetWasm2cExperssion(output, instruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(instruction->offset) + ") >> 2]";
-        }
-        else if (instruction->bytes == 8)
-        {
-            output += "u64[(";
-            expressionDepth++;
-            GetWasm2cExperssion(output, instruction->ptr, depth + 1);
-            expressionDepth--;
-            output += " + " + std::to_string(instruction->offset) + ") >> 3]";
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+            output << escaped;
         }
         else
-        {
-            std::cout << "store with " << std::to_string(instruction->bytes) << " not supported" << std::endl;
-            output += "unimplementedstore" + std::to_string(instruction->bytes);
-        }
-
-        output += " = ";
-
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->value, depth + 1);
-        expressionDepth--;
-
-        if (expressionDepth == 0)
-        {
-            if (instruction->value->_id != wasm::Expression::BlockId)
-                output += ';';
-            output += '\n';
-        }
-        return;
+            output << character;
     }
-    case wasm::Expression::ConstId:
+    output << '"';
+}
+// the stats of every decompiled file as json, for --stats-json
+void WriteDecompileStatsJson(const std::vector<DecompileJob> &decompileJobs, const std::string &path)
+{
+    std::ofstream output(path);
+    if (!output.is_open())
     {
-        wasm::Const *instruction = static_cast<wasm::Const *>(expression);
+        std::cout << "could not open stats file " << path << std::endl;
+        throw std::runtime_error("unable to open stats file");
+    }
 
-        if (expressionDepth == 0)
-            output += indentation + "return ";
-        if (instruction->type == wasm::Type::f32)
-            output += std::to_string(instruction->value.getf32());
-        else if (instruction->type == wasm::Type::f64)
-            output += std::to_string(instruction->value.getf64());
-        else if (instruction->type == wasm::Type::i32)
-            output += std::to_string(instruction->value.geti32());
-        else if (instruction->type == wasm::Type::i64)
-            output += std::to_string(instruction->value.geti64());
-        else
+    output << "{\n  \"peak_resident_bytes\": " << GetPeakResidentBytes() << ",\n  \"files\": [";
+    for (size_t i = 0; i < decompileJobs.size(); i++)
+    {
+        const DecompileJob &job = decompileJobs[i];
+        output << (i != 0 ? ",\n    {" : "\n    {") << "\"input\": ";
+        WriteJsonString(output, job.inputFile);
+        output << ", \"output\": ";
+        WriteJsonString(output, job.outputFile);
+        output << ", \"input_bytes\": " << job.inputSize << ", \"succeeded\": " << (job.succeeded ? "true" : "false") << ",\n      \"phases\": [";
+        for (size_t phase = 0; phase < job.stats.phases.size(); phase++)
         {
-            std::cout << "unable to convert wasm const id " << std::to_string(instruction->type.getID()) << " to string" << std::endl;
-            output += "const" + std::to_string(instruction->type.getID());
+            const DecompileStats::Phase &stats = job.stats.phases[phase];
+            output << (phase != 0 ? ", " : "") << "{\"name\": \"" << stats.name << "\", \"wall_seconds\": " << stats.wallSeconds << ", \"cpu_seconds\": " << stats.cpuSeconds << "}";
         }
-
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
-    }
-    case wasm::Expression::IfId:
-    {
-        wasm::If *instruction = static_cast<wasm::If *>(expression);
-
-        if (expressionDepth == 0)
-            output += indentation;
-
-        output += "if (";
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->condition, depth + 1);
-        expressionDepth--;
-        output += ")\n";
-
-        if (instruction->ifTrue->_id != wasm::Expression::BlockId)
-            indentation += "    ";
-        size_t _expressionDepth = expressionDepth;
-        expressionDepth = 0;
-        GetWasm2cExperssion(output, instruction->ifTrue, depth + 1);
-        expressionDepth = _expressionDepth;
-        if (instruction->ifTrue->_id != wasm::Expression::BlockId)
-            indentation = indentation.substr(4);
-
-        if (instruction->ifFalse != nullptr)
+        output << "],\n      \"inlined_call_sites\": " << job.stats.inlinedCallSites << ",\n      \"functions\": [";
+        for (size_t function = 0; function < job.stats.functions.size(); function++)
         {
-            if (output.back() != '\n')
-                output += '\n';
-            output += indentation + "else\n";
-            if (instruction->ifFalse->_id != wasm::Expression::BlockId)
-                indentation += "    ";
-
-            _expressionDepth = expressionDepth;
-            expressionDepth = 0;
-            GetWasm2cExperssion(output, instruction->ifFalse, depth + 1);
-            expressionDepth = _expressionDepth;
-            if (instruction->ifFalse->_id != wasm::Expression::BlockId)
-                indentation = indentation.substr(4);
+            const DecompileStats::Function &stats = job.stats.functions[function];
+            output << (function != 0 ? ",\n        {" : "\n        {") << "\"name\": ";
+            WriteJsonString(output, stats.name);
+            output << ", \"seconds\": " << stats.seconds << ", \"bytes\": " << stats.bytes << ", \"inlined\": " << (stats.inlined ? "true" : "false") << "}";
         }
-        return;
+        output << "]}";
     }
-    case wasm::Expression::DropId:
-    {
-        wasm::Drop *instruction = static_cast<wasm::Drop *>(expression);
+    output << "\n  ]\n}\n";
+}
+// reads one file and decompiles it to job.outputFile. throws when the file
+// cannot be read
+void Decompile(DecompileJob &job, const Wasm2cOptions &options)
+{
+    PhaseClock phaseClock;
+    std::vector<char> data = ReadDataFromFilePath(job.inputFile);
+    job.inputSize = data.size();
+    phaseClock.Record(job.stats, "read");
 
-        // if (expressionDepth == 0)
-        //     output += indentation;
-        // output += "drop ";
-        GetWasm2cExperssion(output, instruction->value, depth + 1);
-        // output += '\n';
-        return;
-    }
-    case wasm::Expression::SwitchId:
+    job.succeeded = DecompileWasm2c(std::move(data), job.outputFile, options, {}, &job.stats);
+}
+// whether two jobs write the same output, like a/x.wasm and b/x.wasm
+// decompiled into one --output directory. their threads would write the C,
+// the .data file and the cache entries at the same time
+bool HasCollidingOutputs(const std::vector<DecompileJob> &jobs)
+{
+    std::unordered_map<std::string, const DecompileJob *> outputs;
+    bool colliding = false;
+    for (const DecompileJob &job : jobs)
     {
-        wasm::Switch *instruction = static_cast<wasm::Switch *>(expression);
-
-        output += indentation + "switch(";
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->condition, depth + 1);
-        expressionDepth--;
-        output += ")\n" + indentation + "{\n";
-        indentation += "    ";
-        for (size_t i = 0; i < instruction->targets.size(); i++)
+        std::string output = std::filesystem::absolute(job.outputFile).lexically_normal().string();
+        auto [found, inserted] = outputs.emplace(output, &job);
+        if (!inserted)
         {
-            output += indentation + "case " + std::to_string(i) + ": break " + instruction->targets[i].str + ";\n";
+            std::cout << job.inputFile << " and " << found->second->inputFile << " would both be written to " << job.outputFile << std::endl;
+            colliding = true;
         }
-        indentation = indentation.substr(4);
-
-        output += indentation + "}\n";
-        return;
     }
-    case wasm::Expression::ReturnId:
-    {
-        wasm::Return *instruction = static_cast<wasm::Return *>(expression);
+    return colliding;
+}
+// runs task(0) .. task(count - 1) on up to `jobs` threads, each idle worker
+// taking the next unstarted index
+void ParallelFor(size_t count, size_t jobs, const std::function<void(size_t)> &task)
+{
+    jobs = ResolveJobCount(jobs, count);
 
-        output += indentation + "return";
-        if (instruction->value != nullptr)
-        {
-            output += " ";
-            expressionDepth++;
-            GetWasm2cExperssion(output, instruction->value, depth + 1);
-            expressionDepth--;
-        }
-        output += ";\n";
-        return;
-    }
-    case wasm::Expression::GlobalSetId:
+    if (jobs <= 1)
     {
-        wasm::GlobalSet *instruction = static_cast<wasm::GlobalSet *>(expression);
-
-        output += indentation + instruction->name.str + " = ";
-
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->value, depth);
-        expressionDepth--;
-
-        output += ";\n";
+        for (size_t i = 0; i < count; i++)
+            task(i);
         return;
     }
-    case wasm::Expression::GlobalGetId:
-    {
-        wasm::GlobalGet *instruction = static_cast<wasm::GlobalGet *>(expression);
 
-        if (expressionDepth == 0)
-            output += indentation;
+    std::atomic<size_t> nextIndex = 0;
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+    for (size_t worker = 0; worker < jobs; worker++)
+        workers.emplace_back([&]()
+                             {
+                                 for (size_t i = nextIndex++; i < count; i = nextIndex++)
+                                     task(i);
+                             });
 
-        output += instruction->name.str;
+    for (std::thread &worker : workers)
+        worker.join();
+}
+// expands the -i arguments and manifest into the list of .wasm files to
+// decompile. directories contribute every .wasm file inside them, manifest
+// lines are paths relative to the manifest, blank lines and lines starting
+// with # are skipped
+std::vector<std::string> CollectInputFiles(const std::vector<std::string> &inputs, const std::string &manifest)
+{
+    std::vector<std::string> inputFiles;
 
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
-    }
-    case wasm::Expression::LoopId:
+    auto addInput = [&](const std::filesystem::path &path)
     {
-        wasm::Loop *instruction = static_cast<wasm::Loop *>(expression);
-        output += indentation + "while (true)\n";
-        GetWasm2cExperssion(output, instruction->body, depth + 1);
-        return;
-    }
-    case wasm::Expression::SelectId:
-    {
-        wasm::Select *instruction = static_cast<wasm::Select *>(expression);
-
-        if (expressionDepth == 0)
-            output += indentation;
-
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->condition, depth + 1);
-        expressionDepth--;
-
-        output += " ? ";
-
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->ifTrue, depth + 1);
-        expressionDepth--;
+        if (path != "-" && std::filesystem::is_directory(path))
+        {
+            std::vector<std::string> directoryFiles;
+            for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(path))
+                if (entry.is_regular_file() && entry.path().extension() == ".wasm")
+                    directoryFiles.push_back(entry.path().string());
 
-        output += " : ";
+            std::sort(directoryFiles.begin(), directoryFiles.end());
+            inputFiles.insert(inputFiles.end(), directoryFiles.begin(), directoryFiles.end());
+        }
+        else
+            inputFiles.push_back(path.string());
+    };
 
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->ifFalse, depth + 1);
-        expressionDepth--;
+    for (const std::string &input : inputs)
+        addInput(input);
 
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
-    }
-    case wasm::Expression::MemorySizeId:
+    if (!manifest.empty())
     {
-        output += "MEMORY_SIZE";
-        return;
-    }
-    case wasm::Expression::NopId:
-    {
-        return;
-    }
-    case wasm::Expression::CallIndirectId:
-    {
-        wasm::CallIndirect *instruction = static_cast<wasm::CallIndirect *>(expression);
-        if (expressionDepth == 0)
-            output += indentation;
-        output += "FUNCTION_TABLE[";
-        expressionDepth++;
-        GetWasm2cExperssion(output, instruction->target, depth + 1);
-        expressionDepth--;
-        output += "](";
-        expressionDepth++;
-        size_t i = 0;
-        for (wasm::Expression *operand : instruction->operands)
+        std::ifstream manifestStream(manifest);
+        if (!manifestStream.is_open())
         {
-            GetWasm2cExperssion(output, operand, depth + 1);
-            if (i != instruction->operands.size() - 1)
-                output += ", ";
-            i++;
+            std::cout << "could not open manifest " << manifest << std::endl;
+            throw std::runtime_error("unable to open manifest");
         }
-        output += ")";
-        expressionDepth--;
-        if (expressionDepth == 0)
-            output += ";\n";
-        return;
-    }
-    default:
-    {
-        if (expressionDepth == 0)
-            output += indentation;
-        output += "unimplemented" + std::to_string(id);
-        if (expressionDepth == 0)
-            output += ";\n";
-    }
-    }
-}
-std::string GetWasm2cFunctionBody(wasm::Function *function)
-{
-    std::string output;
 
-    if (function->body == nullptr)
-        return "// imported\n";
+        std::filesystem::path manifestDirectory = std::filesystem::path(manifest).parent_path();
+        std::string line;
+        while (std::getline(manifestStream, line))
+        {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#')
+                continue;
 
-    GetWasm2cExperssion(output, function->body, 0);
+            addInput(manifestDirectory / line);
+        }
+    }
 
-    return output;
+    return inputFiles;
 }
-std::string GetWasm2cFunctionLocals(wasm::Function *function)
+void PrintBatchSummary(const std::vector<DecompileJob> &decompileJobs, double totalSeconds)
 {
-    std::string output;
+    size_t succeeded = 0;
+    size_t totalSize = 0;
 
-    for (size_t i = function->getNumParams() - 1; i < function->getNumVars(); i++)
+    std::cout << "\nfile                                      size      read     parse  optimize      emit\n";
+    for (const DecompileJob &job : decompileJobs)
     {
-        std::string local;
-
-        wasm::Type type = function->getLocalType(i);
-
-        local += GetStringFromWasmType(type);
+        char line[512];
+        if (job.succeeded)
+            std::snprintf(line, sizeof(line), "%-36s %10zu %8.3fs %8.3fs %8.3fs %8.3fs\n", job.inputFile.c_str(), job.inputSize, job.stats.WallSeconds("read"), job.stats.WallSeconds("parse"), job.stats.WallSeconds("optimize"), job.stats.WallSeconds("plan") + job.stats.WallSeconds("emit"));
+        else
+            std::snprintf(line, sizeof(line), "%-36s     failed\n", job.inputFile.c_str());
+        std::cout << line;
 
-        output += indentation + local + " v" + std::to_string(i + 1) + ";\n";
+        succeeded += job.succeeded;
+        totalSize += job.inputSize;
     }
 
-    return output;
+    std::cout << "decompiled " << succeeded << " of " << decompileJobs.size() << " files (" << totalSize << " bytes) in " << totalSeconds << "s" << std::endl;
 }
-std::string GenerateWasm2cFunctionBodies(wasm::Module *module)
+int32_t main(int32_t argumentCount, char **argumentValues)
 {
-    std::string output;
-    for (std::unique_ptr<wasm::Function> &function : module->functions)
-    {
-        std::string body;
-        body += GetFunctionSignature(function.get());
-
-        body += "\n{\n"; // open function body
-        indentation += "    ";
+    popl::OptionParser commandLineParser("idk");
 
-        body += GetWasm2cFunctionLocals(function.get());
-        body += GetWasm2cFunctionBody(function.get());
+    std::shared_ptr<popl::Value<std::string>> inputFileOption = commandLineParser.add<popl::Value<std::string>>("i", "input", "the file or directory to read from, - for stdin. may be given more than once");
+    std::shared_ptr<popl::Value<std::string>> outputFileOption = commandLineParser.add<popl::Value<std::string>>("o", "output", "the output file, or the output directory when decompiling several files");
+    std::shared_ptr<popl::Value<std::string>> manifestOption = commandLineParser.add<popl::Value<std::string>>("", "manifest", "a file listing one input path per line");
+    std::shared_ptr<popl::Value<size_t>> jobsOption = commandLineParser.add<popl::Value<size_t>>("j", "jobs", "number of threads emitting function bodies, 0 for one per core", 1);
+    std::shared_ptr<popl::Value<std::string>> cacheOption = commandLineParser.add<popl::Value<std::string>>("", "cache", "directory caching emitted functions between runs");
+    std::shared_ptr<popl::Value<std::string>> entryOption = commandLineParser.add<popl::Value<std::string>>("", "entry", "only decompile this export and the functions it can reach");
+    std::shared_ptr<popl::Switch> keepUnreachableOption = commandLineParser.add<popl::Switch>("", "keep-unreachable", "also emit functions that cannot be reached from the exports, start function or tables");
+    std::shared_ptr<popl::Switch> keepDuplicatesOption = commandLineParser.add<popl::Switch>("", "keep-duplicates", "emit functions identical to an earlier one in full instead of as a #define of it");
+    std::shared_ptr<popl::Value<size_t>> inlineBudgetOption = commandLineParser.add<popl::Value<size_t>>("", "inline-budget", "emit functions calling nothing with at most this many expressions as static inline, 0 for none", 0);
+    std::shared_ptr<popl::Value<std::string>> profileOption = commandLineParser.add<popl::Value<std::string>>("", "profile", "call and branch counts from a run, to emit hot functions first and annotate branches");
+    std::shared_ptr<popl::Value<std::string>> memoryOption = commandLineParser.add<popl::Value<std::string>>("", "memory", "linear memory runtime: none, guard, bounds or mask", "none");
+    std::shared_ptr<popl::Value<std::string>> dataOption = commandLineParser.add<popl::Value<std::string>>("", "data", "where data segments go: none, file, incbin, or auto for file with a memory runtime", "auto");
+    std::shared_ptr<popl::Value<size_t>> shardsOption = commandLineParser.add<popl::Value<size_t>>("", "shards", "split the output into a header and up to this many .c files", 1);
+    std::shared_ptr<popl::Value<std::string>> optimizeOption = commandLineParser.add<popl::Value<std::string>>("O", "optimize", "binaryen optimization before emission: 0, 1, 2, 3, 4, s or z as in -O2", "0");
+    std::shared_ptr<popl::Value<std::string>> passesOption = commandLineParser.add<popl::Value<std::string>>("", "passes", "comma separated binaryen passes to run, after the -O pipeline");
+    std::shared_ptr<popl::Switch> timePassesOption = commandLineParser.add<popl::Switch>("", "time-passes", "print the time every optimization pass takes");
+    std::shared_ptr<popl::Switch> streamOption = commandLineParser.add<popl::Switch>("", "stream", "parse and emit the functions a chunk at a time to bound memory use");
+    std::shared_ptr<popl::Switch> statsOption = commandLineParser.add<popl::Switch>("", "stats", "print the time every phase and function takes, the largest functions and the peak memory use");
+    std::shared_ptr<popl::Value<std::string>> statsJsonOption = commandLineParser.add<popl::Value<std::string>>("", "stats-json", "write the stats of every file to this json file");
 
-        indentation = indentation.substr(4);
-        body += "}";
+    commandLineParser.parse(argumentCount, argumentValues);
 
-        output += body;
-        output += "\n\n";
+    Wasm2cOptions options;
+    options.jobs = jobsOption->value();
+    if (cacheOption->is_set())
+        options.cacheDirectory = cacheOption->value();
+    options.shards = shardsOption->value();
+    if (entryOption->is_set())
+        options.entry = entryOption->value();
+    options.keepUnreachable = keepUnreachableOption->is_set();
+    options.keepDuplicates = keepDuplicatesOption->is_set();
+    options.inlineBudget = inlineBudgetOption->value();
+    if (profileOption->is_set())
+        options.profileFile = profileOption->value();
+
+    if (memoryOption->value() == "none")
+        options.memoryMode = MemoryMode::None;
+    else if (memoryOption->value() == "guard")
+        options.memoryMode = MemoryMode::Guard;
+    else if (memoryOption->value() == "bounds")
+        options.memoryMode = MemoryMode::Bounds;
+    else if (memoryOption->value() == "mask")
+        options.memoryMode = MemoryMode::Mask;
+    else
+    {
+        std::cout << "unknown memory mode " << memoryOption->value() << std::endl;
+        return 1;
     }
 
-    return output;
-}
-std::string GenerateWasm2cFunctionDeclarations(wasm::Module *module)
-{
-    std::string output;
-    for (std::unique_ptr<wasm::Function> &function : module->functions)
+    if (dataOption->value() == "auto")
+        options.dataMode = options.memoryMode != MemoryMode::None ? DataMode::File : DataMode::None;
+    else if (dataOption->value() == "none")
+        options.dataMode = DataMode::None;
+    else if (dataOption->value() == "file")
+        options.dataMode = DataMode::File;
+    else if (dataOption->value() == "incbin")
+        options.dataMode = DataMode::Incbin;
+    else
     {
-        std::string declaration;
-
-        declaration += GetFunctionSignature(function.get());
-
-        declaration += ";\n";
-
-        output += declaration;
+        std::cout << "unknown data mode " << dataOption->value() << std::endl;
+        return 1;
     }
 
-    return output;
-}
-std::string GenerateWasm2cMemory(wasm::Module *module)
-{
-    std::string output;
-    uint64_t memorySize = module->memory.max.addr;
-
-    output += "uint8_t *u8 = (uint8_t *)0\n"
-              "uint16_t *u16 = (uint16_t *)u8;\n"
-              "uint32_t *u32 = (uint32_t *)u8;\n"
-              "uint64_t *u64 = (uint64_t *)u8;\n"
-              "int8_t *i8 = (int8_t *)u8;\n"
-              "int16_t *i16 = (int16_t *)u8;\n"
-              "int32_t *i32 = (int32_t *)u8;\n"
-              "int64_t *i64 = (int64_t *)u8;\n"
-              "float *f32 = (float *)u8;\n"
-              "double *f64 = (double *)u8;\n\n";
-    return output;
-}
-std::string GenerateWasm2cGlobals(wasm::Module *module)
-{
-    std::string globals;
-    for (std::unique_ptr<wasm::Global> &global : module->globals)
+    // the same levels as wasm-opt: -Os and -Oz optimize like -O2 while
+    // also shrinking the code
+    const std::string &optimizeLevel = optimizeOption->value();
+    if (optimizeLevel.size() == 1 && optimizeLevel[0] >= '0' && optimizeLevel[0] <= '4')
+        options.optimizeLevel = optimizeLevel[0] - '0';
+    else if (optimizeLevel == "s" || optimizeLevel == "z")
     {
-        wasm::Const *wasmConstant = global->init->dynCast<wasm::Const>();
-        std::string globalValue;
-        std::string type = GetStringFromWasmType(wasmConstant->type);
-
-        if (wasmConstant->type == wasm::Type::i32)
-        {
-            globalValue = std::to_string(wasmConstant->value.geti32());
-        }
-        else
-        {
-            globalValue = "unknown";
-        }
-        globals += type + " " + global->name.str + " = " + globalValue + ";\n";
+        options.optimizeLevel = 2;
+        options.shrinkLevel = optimizeLevel == "s" ? 1 : 2;
+    }
+    else
+    {
+        std::cout << "unknown optimization level -O" << optimizeLevel << std::endl;
+        return 1;
     }
 
-    globals += "\n";
-
-    return globals;
-}
-std::string GenerateWasm2c(wasm::Module *module)
-{
-    std::string output;
-    output += "#include <stdint.h>\n"
-              "\n";
+    // the names are checked by DecompileWasm2c
+    if (passesOption->is_set())
+    {
+        std::stringstream passList(passesOption->value());
+        std::string pass;
+        while (std::getline(passList, pass, ','))
+            if (!pass.empty())
+                options.passes.push_back(pass);
+    }
+    options.timePasses = timePassesOption->is_set();
 
-    output += GenerateWasm2cGlobals(module);
-    output += GenerateWasm2cMemory(module);
-    output += GenerateWasm2cFunctionDeclarations(module);
-    output += GenerateWasm2cFunctionBodies(module);
+    options.stream = streamOption->is_set();
 
-    return output;
-}
-void WriteOutput(wasm::Module *module, const std::string &outputFile)
-{
-    std::ofstream ouputFileStream(outputFile);
+    options.stats = statsOption->is_set() || statsJsonOption->is_set();
 
-    ouputFileStream << GenerateWasm2c(module);
-}
-std::vector<char> ReadDataFromFilePath(const std::string &path)
-{
-    std::ifstream fileStream(path, std::ios::binary);
-    if (!fileStream.is_open())
+    if (!inputFileOption->is_set() && !manifestOption->is_set())
     {
-        std::cout << "could not open file path " << path << std::endl;
-        throw std::runtime_error("unable to open file");
+        std::cout << "--input option not specified" << std::endl;
+        return 1;
     }
 
-    std::vector<char> fileData;
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < inputFileOption->count(); i++)
+        inputs.push_back(inputFileOption->value(i));
 
-    char byte;
-    while (fileStream.get(byte))
-        fileData.push_back(byte);
+    bool batch = inputs.size() != 1 || manifestOption->is_set() || (inputs[0] != "-" && std::filesystem::is_directory(inputs[0]));
 
-    std::cout << "read file of " << fileData.size() << " size" << std::endl;
-    return fileData;
-}
-int32_t main(int32_t argumentCount, char **argumentValues)
-{
-    popl::OptionParser commandLineParser("idk");
+    if (!batch)
+    {
+        DecompileJob job;
+        job.inputFile = inputs[0];
+        job.outputFile = outputFileOption->is_set() ? outputFileOption->value() : "a.c";
 
-    std::shared_ptr<popl::Value<std::string>> inputFileOption = commandLineParser.add<popl::Value<std::string>>("i", "input", "the file to read from");
-    std::shared_ptr<popl::Value<std::string>> outputFileOption = commandLineParser.add<popl::Value<std::string>>("o", "output", "the output file");
-    std::string outputFile;
-    std::string inputFile;
+        Decompile(job, options);
+        if (!job.succeeded)
+            return 1;
+        if (statsOption->is_set())
+            PrintDecompileStats(job);
+        if (statsJsonOption->is_set())
+            WriteDecompileStatsJson({job}, statsJsonOption->value());
 
-    commandLineParser.parse(argumentCount, argumentValues);
+        return 0;
+    }
+
+    // batch mode: one output per input, either next to the input or in the
+    // --output directory. the files are spread over the job threads
+    std::vector<std::string> inputFiles = CollectInputFiles(inputs, manifestOption->is_set() ? manifestOption->value() : "");
+    std::vector<DecompileJob> decompileJobs(inputFiles.size());
 
     if (outputFileOption->is_set())
-        outputFile = outputFileOption->value();
-    else
-        outputFile = "a.c";
+        std::filesystem::create_directories(outputFileOption->value());
 
-    if (!inputFileOption->is_set())
+    for (size_t i = 0; i < inputFiles.size(); i++)
     {
-        std::cout << "--input option not specified" << std::endl;
+        std::filesystem::path inputPath = inputFiles[i];
+        std::filesystem::path outputName = inputPath.filename().string() + ".c";
+
+        decompileJobs[i].inputFile = inputFiles[i];
+        decompileJobs[i].outputFile = (outputFileOption->is_set() ? std::filesystem::path(outputFileOption->value()) / outputName : inputPath.parent_path() / outputName).string();
+    }
+    if (HasCollidingOutputs(decompileJobs))
+    {
+        std::cout << "every input needs its own output, rename the inputs or decompile them without --output" << std::endl;
         return 1;
     }
-    inputFile = inputFileOption->value();
-
-    std::vector<char> data = ReadDataFromFilePath(inputFile);
-
-    wasm::Module *module = ParseWasm(data);
-
-    WriteOutput(module, outputFile);
 
-    delete module;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ParallelFor(decompileJobs.size(), jobsOption->value(), [&](size_t index)
+                {
+                    try
+                    {
+                        Wasm2cOptions fileOptions = options;
+                        fileOptions.jobs = 1;
+                        Decompile(decompileJobs[index], fileOptions);
+                        if (!decompileJobs[index].succeeded)
+                            throw std::runtime_error("unable to decompile");
+                        if (statsOption->is_set())
+                            PrintDecompileStats(decompileJobs[index]);
+                    }
+                    catch (...)
+                    {
+                        std::cout << "failed to decompile " << decompileJobs[index].inputFile << std::endl;
+                    }
+                });
+
+    PrintBatchSummary(decompileJobs, SecondsSince(start));
+    if (statsJsonOption->is_set())
+        WriteDecompileStatsJson(decompileJobs, statsJsonOption->value());
+
+    for (const DecompileJob &job : decompileJobs)
+        if (!job.succeeded)
+            return 1;
 
     return 0;
 }
@@ -0,0 +1,917 @@
+// 128 bit SIMD for the C that wasm2c emits from modules using v128.
+// every operation is a function or macro named after its binaryen operation,
+// e.g. __AddVecI32x4(a, b). with SSE4.1 available (-msse4.1, -mavx2 or
+// -march=native) v128 is __m128i and the operations are x86 intrinsics, and
+// AVX2 is used for the splats. anywhere else, or with WASM2C_SIMD_SCALAR
+// defined, every operation is portable scalar code over the lanes
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE4_1__) && !defined(WASM2C_SIMD_SCALAR)
+#define WASM2C_SIMD_SSE 1
+#include <immintrin.h>
+typedef __m128i v128;
+#else
+#define WASM2C_SIMD_SSE 0
+typedef struct
+{
+    _Alignas(16) uint8_t bytes[16];
+} v128;
+#endif
+
+// lanes are read and written through memcpy, which works for both
+// representations of v128 and compiles to plain vector moves
+#define WASM2C_SIMD_LANES(type, count, name, vector) \
+    type name[count];                                \
+    memcpy(name, &(vector), 16)
+#define WASM2C_SIMD_RESULT(name) \
+    v128 result;                 \
+    memcpy(&result, name, 16);   \
+    return result
+
+// lanewise operations. the scalar expression reads the lanes X and Y. the
+// _X86 variants take the intrinsic expression over a and b used with SSE
+#define WASM2C_SIMD_UNARY(name, type, count, scalar)  \
+    static inline v128 name(v128 a)                   \
+    {                                                 \
+        WASM2C_SIMD_LANES(type, count, x, a);         \
+        type r[count];                                \
+        for (int i = 0; i < count; i++)               \
+        {                                             \
+            type X = x[i];                            \
+            r[i] = (type)(scalar);                    \
+        }                                             \
+        WASM2C_SIMD_RESULT(r);                        \
+    }
+#define WASM2C_SIMD_BINARY(name, type, count, scalar) \
+    static inline v128 name(v128 a, v128 b)           \
+    {                                                 \
+        WASM2C_SIMD_LANES(type, count, x, a);         \
+        WASM2C_SIMD_LANES(type, count, y, b);         \
+        type r[count];                                \
+        for (int i = 0; i < count; i++)               \
+        {                                             \
+            type X = x[i], Y = y[i];                  \
+            r[i] = (type)(scalar);                    \
+        }                                             \
+        WASM2C_SIMD_RESULT(r);                        \
+    }
+// comparisons set every bit of a lane where the scalar condition holds
+#define WASM2C_SIMD_COMPARE(name, type, maskType, count, scalar) \
+    static inline v128 name(v128 a, v128 b)                      \
+    {                                                            \
+        WASM2C_SIMD_LANES(type, count, x, a);                    \
+        WASM2C_SIMD_LANES(type, count, y, b);                    \
+        maskType r[count];                                       \
+        for (int i = 0; i < count; i++)                          \
+        {                                                        \
+            type X = x[i], Y = y[i];                             \
+            r[i] = (scalar) ? (maskType)-1 : 0;                  \
+        }                                                        \
+        WASM2C_SIMD_RESULT(r);                                   \
+    }
+
+#if WASM2C_SIMD_SSE
+#define WASM2C_SIMD_UNARY_X86(name, type, count, scalar, sse) \
+    static inline v128 name(v128 a)                           \
+    {                                                         \
+        return (sse);                                         \
+    }
+#define WASM2C_SIMD_BINARY_X86(name, type, count, scalar, sse) \
+    static inline v128 name(v128 a, v128 b)                    \
+    {                                                          \
+        return (sse);                                          \
+    }
+#define WASM2C_SIMD_COMPARE_X86(name, type, maskType, count, scalar, sse) \
+    static inline v128 name(v128 a, v128 b)                               \
+    {                                                                     \
+        return (sse);                                                     \
+    }
+#define WASM2C_SIMD_F32(vector) _mm_castsi128_ps(vector)
+#define WASM2C_SIMD_F64(vector) _mm_castsi128_pd(vector)
+#define WASM2C_SIMD_FROM_F32(vector) _mm_castps_si128(vector)
+#define WASM2C_SIMD_FROM_F64(vector) _mm_castpd_si128(vector)
+#define WASM2C_SIMD_ONES _mm_set1_epi32(-1)
+#else
+#define WASM2C_SIMD_UNARY_X86(name, type, count, scalar, sse) WASM2C_SIMD_UNARY(name, type, count, scalar)
+#define WASM2C_SIMD_BINARY_X86(name, type, count, scalar, sse) WASM2C_SIMD_BINARY(name, type, count, scalar)
+#define WASM2C_SIMD_COMPARE_X86(name, type, maskType, count, scalar, sse) WASM2C_SIMD_COMPARE(name, type, maskType, count, scalar)
+#endif
+
+// scalar helpers following the wasm semantics
+
+static inline float wasm2c_simd_minf(float x, float y)
+{
+    if (x != x || y != y)
+        return NAN;
+    if (x == y)
+        return signbit(x) ? x : y;
+    return x < y ? x : y;
+}
+static inline float wasm2c_simd_maxf(float x, float y)
+{
+    if (x != x || y != y)
+        return NAN;
+    if (x == y)
+        return signbit(x) ? y : x;
+    return x > y ? x : y;
+}
+static inline double wasm2c_simd_min(double x, double y)
+{
+    if (x != x || y != y)
+        return NAN;
+    if (x == y)
+        return signbit(x) ? x : y;
+    return x < y ? x : y;
+}
+static inline double wasm2c_simd_max(double x, double y)
+{
+    if (x != x || y != y)
+        return NAN;
+    if (x == y)
+        return signbit(x) ? y : x;
+    return x > y ? x : y;
+}
+static inline int32_t wasm2c_simd_trunc_sat_s(double x)
+{
+    if (x != x)
+        return 0;
+    if (x <= -2147483648.0)
+        return INT32_MIN;
+    if (x >= 2147483647.0)
+        return INT32_MAX;
+    return (int32_t)x;
+}
+static inline uint32_t wasm2c_simd_trunc_sat_u(double x)
+{
+    if (x != x || x <= 0)
+        return 0;
+    if (x >= 4294967295.0)
+        return UINT32_MAX;
+    return (uint32_t)x;
+}
+static inline int8_t wasm2c_simd_saturate_s8(int32_t x)
+{
+    return x < INT8_MIN ? INT8_MIN : x > INT8_MAX ? INT8_MAX : x;
+}
+static inline uint8_t wasm2c_simd_saturate_u8(int32_t x)
+{
+    return x < 0 ? 0 : x > UINT8_MAX ? UINT8_MAX : x;
+}
+static inline int16_t wasm2c_simd_saturate_s16(int32_t x)
+{
+    return x < INT16_MIN ? INT16_MIN : x > INT16_MAX ? INT16_MAX : x;
+}
+static inline uint16_t wasm2c_simd_saturate_u16(int32_t x)
+{
+    return x < 0 ? 0 : x > UINT16_MAX ? UINT16_MAX : x;
+}
+
+// constants and splats
+
+#if WASM2C_SIMD_SSE
+#define __ConstVec128(low, high) _mm_set_epi64x((int64_t)(high), (int64_t)(low))
+#else
+static inline v128 __ConstVec128(uint64_t low, uint64_t high)
+{
+    uint64_t r[2] = {low, high};
+    WASM2C_SIMD_RESULT(r);
+}
+#endif
+
+#if WASM2C_SIMD_SSE && defined(__AVX2__)
+static inline v128 __SplatVecI8x16(int32_t x) { return _mm_broadcastb_epi8(_mm_cvtsi32_si128(x)); }
+static inline v128 __SplatVecI16x8(int32_t x) { return _mm_broadcastw_epi16(_mm_cvtsi32_si128(x)); }
+static inline v128 __SplatVecI32x4(int32_t x) { return _mm_broadcastd_epi32(_mm_cvtsi32_si128(x)); }
+static inline v128 __SplatVecI64x2(int64_t x) { return _mm_broadcastq_epi64(_mm_cvtsi64_si128(x)); }
+static inline v128 __SplatVecF32x4(float x) { return _mm_castps_si128(_mm_broadcastss_ps(_mm_set_ss(x))); }
+static inline v128 __SplatVecF64x2(double x) { return _mm_castpd_si128(_mm_movedup_pd(_mm_set_sd(x))); }
+#elif WASM2C_SIMD_SSE
+static inline v128 __SplatVecI8x16(int32_t x) { return _mm_set1_epi8((char)x); }
+static inline v128 __SplatVecI16x8(int32_t x) { return _mm_set1_epi16((short)x); }
+static inline v128 __SplatVecI32x4(int32_t x) { return _mm_set1_epi32(x); }
+static inline v128 __SplatVecI64x2(int64_t x) { return _mm_set1_epi64x(x); }
+static inline v128 __SplatVecF32x4(float x) { return _mm_castps_si128(_mm_set1_ps(x)); }
+static inline v128 __SplatVecF64x2(double x) { return _mm_castpd_si128(_mm_set1_pd(x)); }
+#else
+#define WASM2C_SIMD_SPLAT(name, argumentType, type, count) \
+    static inline v128 name(argumentType x)                \
+    {                                                      \
+        type r[count];                                     \
+        for (int i = 0; i < count; i++)                    \
+            r[i] = (type)x;                                \
+        WASM2C_SIMD_RESULT(r);                             \
+    }
+WASM2C_SIMD_SPLAT(__SplatVecI8x16, int32_t, uint8_t, 16)
+WASM2C_SIMD_SPLAT(__SplatVecI16x8, int32_t, uint16_t, 8)
+WASM2C_SIMD_SPLAT(__SplatVecI32x4, int32_t, uint32_t, 4)
+WASM2C_SIMD_SPLAT(__SplatVecI64x2, int64_t, uint64_t, 2)
+WASM2C_SIMD_SPLAT(__SplatVecF32x4, float, float, 4)
+WASM2C_SIMD_SPLAT(__SplatVecF64x2, double, double, 2)
+#endif
+
+// lane access. the lane is a constant, which the x86 instructions need as
+// an immediate, so these are macros there
+
+#if WASM2C_SIMD_SSE
+#define __ExtractLaneSVecI8x16(a, lane) ((int32_t)(int8_t)_mm_extract_epi8((a), (lane)))
+#define __ExtractLaneUVecI8x16(a, lane) ((int32_t)(uint8_t)_mm_extract_epi8((a), (lane)))
+#define __ExtractLaneSVecI16x8(a, lane) ((int32_t)(int16_t)_mm_extract_epi16((a), (lane)))
+#define __ExtractLaneUVecI16x8(a, lane) ((int32_t)(uint16_t)_mm_extract_epi16((a), (lane)))
+#define __ExtractLaneVecI32x4(a, lane) ((int32_t)_mm_extract_epi32((a), (lane)))
+#define __ExtractLaneVecI64x2(a, lane) ((int64_t)_mm_extract_epi64((a), (lane)))
+#define __ExtractLaneVecF32x4(a, lane) _mm_cvtss_f32(_mm_castsi128_ps(_mm_srli_si128((a), (lane) * 4)))
+#define __ExtractLaneVecF64x2(a, lane) _mm_cvtsd_f64(_mm_castsi128_pd(_mm_srli_si128((a), (lane) * 8)))
+#define __ReplaceLaneVecI8x16(a, x, lane) _mm_insert_epi8((a), (x), (lane))
+#define __ReplaceLaneVecI16x8(a, x, lane) _mm_insert_epi16((a), (x), (lane))
+#define __ReplaceLaneVecI32x4(a, x, lane) _mm_insert_epi32((a), (x), (lane))
+#define __ReplaceLaneVecI64x2(a, x, lane) _mm_insert_epi64((a), (x), (lane))
+#define __ReplaceLaneVecF32x4(a, x, lane) _mm_castps_si128(_mm_insert_ps(_mm_castsi128_ps(a), _mm_set_ss(x), (lane) << 4))
+#define __ReplaceLaneVecF64x2(a, x, lane) ((lane) == 0 ? _mm_castpd_si128(_mm_move_sd(_mm_castsi128_pd(a), _mm_set_sd(x))) : _mm_castpd_si128(_mm_unpacklo_pd(_mm_castsi128_pd(a), _mm_set_sd(x))))
+#else
+#define WASM2C_SIMD_EXTRACT(name, resultType, type, count) \
+    static inline resultType name(v128 a, int lane)        \
+    {                                                      \
+        WASM2C_SIMD_LANES(type, count, x, a);              \
+        return (resultType)x[lane];                        \
+    }
+#define WASM2C_SIMD_REPLACE(name, argumentType, type, count)     \
+    static inline v128 name(v128 a, argumentType value, int lane) \
+    {                                                             \
+        WASM2C_SIMD_LANES(type, count, x, a);                     \
+        x[lane] = (type)value;                                    \
+        WASM2C_SIMD_RESULT(x);                                    \
+    }
+WASM2C_SIMD_EXTRACT(__ExtractLaneSVecI8x16, int32_t, int8_t, 16)
+WASM2C_SIMD_EXTRACT(__ExtractLaneUVecI8x16, int32_t, uint8_t, 16)
+WASM2C_SIMD_EXTRACT(__ExtractLaneSVecI16x8, int32_t, int16_t, 8)
+WASM2C_SIMD_EXTRACT(__ExtractLaneUVecI16x8, int32_t, uint16_t, 8)
+WASM2C_SIMD_EXTRACT(__ExtractLaneVecI32x4, int32_t, int32_t, 4)
+WASM2C_SIMD_EXTRACT(__ExtractLaneVecI64x2, int64_t, int64_t, 2)
+WASM2C_SIMD_EXTRACT(__ExtractLaneVecF32x4, float, float, 4)
+WASM2C_SIMD_EXTRACT(__ExtractLaneVecF64x2, double, double, 2)
+WASM2C_SIMD_REPLACE(__ReplaceLaneVecI8x16, int32_t, uint8_t, 16)
+WASM2C_SIMD_REPLACE(__ReplaceLaneVecI16x8, int32_t, uint16_t, 8)
+WASM2C_SIMD_REPLACE(__ReplaceLaneVecI32x4, int32_t, uint32_t, 4)
+WASM2C_SIMD_REPLACE(__ReplaceLaneVecI64x2, int64_t, uint64_t, 2)
+WASM2C_SIMD_REPLACE(__ReplaceLaneVecF32x4, float, float, 4)
+WASM2C_SIMD_REPLACE(__ReplaceLaneVecF64x2, double, double, 2)
+#endif
+
+// i8x16.shuffle with the 16 lane indexes packed into two little endian
+// words. indexes 16 to 31 select from b
+static inline v128 __ShuffleVecI8x16(v128 a, v128 b, uint64_t low, uint64_t high)
+{
+#if WASM2C_SIMD_SSE
+    __m128i indexes = _mm_set_epi64x((int64_t)high, (int64_t)low);
+    // pshufb zeroes lanes whose index has the top bit set
+    __m128i fromA = _mm_or_si128(indexes, _mm_cmpgt_epi8(indexes, _mm_set1_epi8(15)));
+    __m128i fromB = _mm_sub_epi8(indexes, _mm_set1_epi8(16));
+    return _mm_or_si128(_mm_shuffle_epi8(a, fromA), _mm_shuffle_epi8(b, fromB));
+#else
+    uint8_t indexes[16], x[32], r[16];
+    memcpy(indexes, &low, 8);
+    memcpy(indexes + 8, &high, 8);
+    memcpy(x, &a, 16);
+    memcpy(x + 16, &b, 16);
+    for (int i = 0; i < 16; i++)
+        r[i] = x[indexes[i] & 31];
+    WASM2C_SIMD_RESULT(r);
+#endif
+}
+static inline v128 __SwizzleVecI8x16(v128 a, v128 b)
+{
+#if WASM2C_SIMD_SSE
+    // indexes above 15 saturate into the top bit, which zeroes the lane
+    return _mm_shuffle_epi8(a, _mm_adds_epu8(b, _mm_set1_epi8(0x70)));
+#else
+    WASM2C_SIMD_LANES(uint8_t, 16, x, a);
+    WASM2C_SIMD_LANES(uint8_t, 16, y, b);
+    uint8_t r[16];
+    for (int i = 0; i < 16; i++)
+        r[i] = y[i] < 16 ? x[y[i]] : 0;
+    WASM2C_SIMD_RESULT(r);
+#endif
+}
+
+// bitwise
+
+WASM2C_SIMD_UNARY_X86(__NotVec128, uint64_t, 2, ~X, _mm_xor_si128(a, WASM2C_SIMD_ONES))
+WASM2C_SIMD_BINARY_X86(__AndVec128, uint64_t, 2, X &Y, _mm_and_si128(a, b))
+WASM2C_SIMD_BINARY_X86(__OrVec128, uint64_t, 2, X | Y, _mm_or_si128(a, b))
+WASM2C_SIMD_BINARY_X86(__XorVec128, uint64_t, 2, X ^ Y, _mm_xor_si128(a, b))
+WASM2C_SIMD_BINARY_X86(__AndNotVec128, uint64_t, 2, X & ~Y, _mm_andnot_si128(b, a))
+static inline v128 __BitselectVec128(v128 a, v128 b, v128 mask)
+{
+#if WASM2C_SIMD_SSE
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+#else
+    return __OrVec128(__AndVec128(a, mask), __AndNotVec128(b, mask));
+#endif
+}
+static inline int32_t __AnyTrueVec128(v128 a)
+{
+#if WASM2C_SIMD_SSE
+    return !_mm_testz_si128(a, a);
+#else
+    WASM2C_SIMD_LANES(uint64_t, 2, x, a);
+    return (x[0] | x[1]) != 0;
+#endif
+}
+
+// integer arithmetic. the scalar code works on unsigned lanes, so wrapping
+// is defined, and casts to signed where the operation is signed
+
+WASM2C_SIMD_BINARY_X86(__AddVecI8x16, uint8_t, 16, X + Y, _mm_add_epi8(a, b))
+WASM2C_SIMD_BINARY_X86(__AddVecI16x8, uint16_t, 8, X + Y, _mm_add_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__AddVecI32x4, uint32_t, 4, X + Y, _mm_add_epi32(a, b))
+WASM2C_SIMD_BINARY_X86(__AddVecI64x2, uint64_t, 2, X + Y, _mm_add_epi64(a, b))
+WASM2C_SIMD_BINARY_X86(__SubVecI8x16, uint8_t, 16, X - Y, _mm_sub_epi8(a, b))
+WASM2C_SIMD_BINARY_X86(__SubVecI16x8, uint16_t, 8, X - Y, _mm_sub_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__SubVecI32x4, uint32_t, 4, X - Y, _mm_sub_epi32(a, b))
+WASM2C_SIMD_BINARY_X86(__SubVecI64x2, uint64_t, 2, X - Y, _mm_sub_epi64(a, b))
+WASM2C_SIMD_BINARY_X86(__MulVecI16x8, uint16_t, 8, (uint32_t)X * Y, _mm_mullo_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__MulVecI32x4, uint32_t, 4, X * Y, _mm_mullo_epi32(a, b))
+WASM2C_SIMD_BINARY(__MulVecI64x2, uint64_t, 2, X * Y)
+WASM2C_SIMD_UNARY_X86(__NegVecI8x16, uint8_t, 16, 0u - X, _mm_sub_epi8(_mm_setzero_si128(), a))
+WASM2C_SIMD_UNARY_X86(__NegVecI16x8, uint16_t, 8, 0u - X, _mm_sub_epi16(_mm_setzero_si128(), a))
+WASM2C_SIMD_UNARY_X86(__NegVecI32x4, uint32_t, 4, 0u - X, _mm_sub_epi32(_mm_setzero_si128(), a))
+WASM2C_SIMD_UNARY_X86(__NegVecI64x2, uint64_t, 2, 0u - X, _mm_sub_epi64(_mm_setzero_si128(), a))
+WASM2C_SIMD_UNARY_X86(__AbsVecI8x16, uint8_t, 16, (int8_t)X < 0 ? 0u - X : X, _mm_abs_epi8(a))
+WASM2C_SIMD_UNARY_X86(__AbsVecI16x8, uint16_t, 8, (int16_t)X < 0 ? 0u - X : X, _mm_abs_epi16(a))
+WASM2C_SIMD_UNARY_X86(__AbsVecI32x4, uint32_t, 4, (int32_t)X < 0 ? 0u - X : X, _mm_abs_epi32(a))
+WASM2C_SIMD_UNARY(__AbsVecI64x2, uint64_t, 2, (int64_t)X < 0 ? 0u - X : X)
+
+WASM2C_SIMD_BINARY_X86(__AddSatSVecI8x16, int8_t, 16, wasm2c_simd_saturate_s8(X + Y), _mm_adds_epi8(a, b))
+WASM2C_SIMD_BINARY_X86(__AddSatUVecI8x16, uint8_t, 16, wasm2c_simd_saturate_u8(X + Y), _mm_adds_epu8(a, b))
+WASM2C_SIMD_BINARY_X86(__SubSatSVecI8x16, int8_t, 16, wasm2c_simd_saturate_s8(X - Y), _mm_subs_epi8(a, b))
+WASM2C_SIMD_BINARY_X86(__SubSatUVecI8x16, uint8_t, 16, wasm2c_simd_saturate_u8(X - Y), _mm_subs_epu8(a, b))
+WASM2C_SIMD_BINARY_X86(__AddSatSVecI16x8, int16_t, 8, wasm2c_simd_saturate_s16(X + Y), _mm_adds_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__AddSatUVecI16x8, uint16_t, 8, wasm2c_simd_saturate_u16(X + Y), _mm_adds_epu16(a, b))
+WASM2C_SIMD_BINARY_X86(__SubSatSVecI16x8, int16_t, 8, wasm2c_simd_saturate_s16(X - Y), _mm_subs_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__SubSatUVecI16x8, uint16_t, 8, wasm2c_simd_saturate_u16(X - Y), _mm_subs_epu16(a, b))
+
+WASM2C_SIMD_BINARY_X86(__MinSVecI8x16, int8_t, 16, X < Y ? X : Y, _mm_min_epi8(a, b))
+WASM2C_SIMD_BINARY_X86(__MinUVecI8x16, uint8_t, 16, X < Y ? X : Y, _mm_min_epu8(a, b))
+WASM2C_SIMD_BINARY_X86(__MaxSVecI8x16, int8_t, 16, X > Y ? X : Y, _mm_max_epi8(a, b))
+WASM2C_SIMD_BINARY_X86(__MaxUVecI8x16, uint8_t, 16, X > Y ? X : Y, _mm_max_epu8(a, b))
+WASM2C_SIMD_BINARY_X86(__MinSVecI16x8, int16_t, 8, X < Y ? X : Y, _mm_min_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__MinUVecI16x8, uint16_t, 8, X < Y ? X : Y, _mm_min_epu16(a, b))
+WASM2C_SIMD_BINARY_X86(__MaxSVecI16x8, int16_t, 8, X > Y ? X : Y, _mm_max_epi16(a, b))
+WASM2C_SIMD_BINARY_X86(__MaxUVecI16x8, uint16_t, 8, X > Y ? X : Y, _mm_max_epu16(a, b))
+WASM2C_SIMD_BINARY_X86(__MinSVecI32x4, int32_t, 4, X < Y ? X : Y, _mm_min_epi32(a, b))
+WASM2C_SIMD_BINARY_X86(__MinUVecI32x4, uint32_t, 4, X < Y ? X : Y, _mm_min_epu32(a, b))
+WASM2C_SIMD_BINARY_X86(__MaxSVecI32x4, int32_t, 4, X > Y ? X : Y, _mm_max_epi32(a, b))
+WASM2C_SIMD_BINARY_X86(__MaxUVecI32x4, uint32_t, 4, X > Y ? X : Y, _mm_max_epu32(a, b))
+WASM2C_SIMD_BINARY_X86(__AvgrUVecI8x16, uint8_t, 16, (X + Y + 1) >> 1, _mm_avg_epu8(a, b))
+WASM2C_SIMD_BINARY_X86(__AvgrUVecI16x8, uint16_t, 8, (X + Y + 1) >> 1, _mm_avg_epu16(a, b))
+
+static inline v128 __Q15MulrSatSVecI16x8(v128 a, v128 b)
+{
+#if WASM2C_SIMD_SSE
+    // pmulhrsw only differs for -32768 * -32768, which it wraps to -32768
+    __m128i r = _mm_mulhrs_epi16(a, b);
+    return _mm_xor_si128(r, _mm_cmpeq_epi16(r, _mm_set1_epi16(INT16_MIN)));
+#else
+    WASM2C_SIMD_LANES(int16_t, 8, x, a);
+    WASM2C_SIMD_LANES(int16_t, 8, y, b);
+    int16_t r[8];
+    for (int i = 0; i < 8; i++)
+        r[i] = wasm2c_simd_saturate_s16((x[i] * y[i] + 0x4000) >> 15);
+    WASM2C_SIMD_RESULT(r);
+#endif
+}
+static inline v128 __DotSVecI16x8ToVecI32x4(v128 a, v128 b)
+{
+#if WASM2C_SIMD_SSE
+    return _mm_madd_epi16(a, b);
+#else
+    WASM2C_SIMD_LANES(int16_t, 8, x, a);
+    WASM2C_SIMD_LANES(int16_t, 8, y, b);
+    uint32_t r[4];
+    for (int i = 0; i < 4; i++)
+        r[i] = (uint32_t)(x[2 * i] * y[2 * i]) + (uint32_t)(x[2 * i + 1] * y[2 * i + 1]);
+    WASM2C_SIMD_RESULT(r);
+#endif
+}
+
+// shifts take the count modulo the lane width
+
+#if WASM2C_SIMD_SSE
+#define WASM2C_SIMD_SHIFT_X86(name, type, count, scalar, sse) \
+    static inline v128 name(v128 a, int32_t shift)            \
+    {                                                         \
+        __m128i n = _mm_cvtsi32_si128(shift & (sizeof(type) * 8 - 1)); \
+        return (sse);                                         \
+    }
+#else
+#define WASM2C_SIMD_SHIFT_X86(name, type, count, scalar, sse) WASM2C_SIMD_SHIFT(name, type, count, scalar)
+#endif
+#define WASM2C_SIMD_SHIFT(name, type, count, scalar)        \
+    static inline v128 name(v128 a, int32_t shift)          \
+    {                                                       \
+        int n = shift & (sizeof(type) * 8 - 1);             \
+        WASM2C_SIMD_LANES(type, count, x, a);               \
+        type r[count];                                      \
+        for (int i = 0; i < count; i++)                     \
+        {                                                   \
+            type X = x[i];                                  \
+            r[i] = (type)(scalar);                          \
+        }                                                   \
+        WASM2C_SIMD_RESULT(r);                              \
+    }
+WASM2C_SIMD_SHIFT(__ShlVecI8x16, uint8_t, 16, X << n)
+WASM2C_SIMD_SHIFT(__ShrSVecI8x16, int8_t, 16, X >> n)
+WASM2C_SIMD_SHIFT(__ShrUVecI8x16, uint8_t, 16, X >> n)
+WASM2C_SIMD_SHIFT_X86(__ShlVecI16x8, uint16_t, 8, X << n, _mm_sll_epi16(a, n))
+WASM2C_SIMD_SHIFT_X86(__ShrSVecI16x8, int16_t, 8, X >> n, _mm_sra_epi16(a, n))
+WASM2C_SIMD_SHIFT_X86(__ShrUVecI16x8, uint16_t, 8, X >> n, _mm_srl_epi16(a, n))
+WASM2C_SIMD_SHIFT_X86(__ShlVecI32x4, uint32_t, 4, X << n, _mm_sll_epi32(a, n))
+WASM2C_SIMD_SHIFT_X86(__ShrSVecI32x4, int32_t, 4, X >> n, _mm_sra_epi32(a, n))
+WASM2C_SIMD_SHIFT_X86(__ShrUVecI32x4, uint32_t, 4, X >> n, _mm_srl_epi32(a, n))
+WASM2C_SIMD_SHIFT_X86(__ShlVecI64x2, uint64_t, 2, X << n, _mm_sll_epi64(a, n))
+WASM2C_SIMD_SHIFT(__ShrSVecI64x2, int64_t, 2, X >> n)
+WASM2C_SIMD_SHIFT_X86(__ShrUVecI64x2, uint64_t, 2, X >> n, _mm_srl_epi64(a, n))
+
+// integer comparisons. x86 only compares signed for greater and equal, the
+// rest is derived from those, and unsigned ones from min and max
+
+WASM2C_SIMD_COMPARE_X86(__EqVecI8x16, uint8_t, uint8_t, 16, X == Y, _mm_cmpeq_epi8(a, b))
+WASM2C_SIMD_COMPARE_X86(__NeVecI8x16, uint8_t, uint8_t, 16, X != Y, _mm_xor_si128(_mm_cmpeq_epi8(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LtSVecI8x16, int8_t, uint8_t, 16, X < Y, _mm_cmpgt_epi8(b, a))
+WASM2C_SIMD_COMPARE_X86(__GtSVecI8x16, int8_t, uint8_t, 16, X > Y, _mm_cmpgt_epi8(a, b))
+WASM2C_SIMD_COMPARE_X86(__LeSVecI8x16, int8_t, uint8_t, 16, X <= Y, _mm_xor_si128(_mm_cmpgt_epi8(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GeSVecI8x16, int8_t, uint8_t, 16, X >= Y, _mm_xor_si128(_mm_cmpgt_epi8(b, a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LtUVecI8x16, uint8_t, uint8_t, 16, X < Y, _mm_xor_si128(_mm_cmpeq_epi8(_mm_max_epu8(a, b), a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GtUVecI8x16, uint8_t, uint8_t, 16, X > Y, _mm_xor_si128(_mm_cmpeq_epi8(_mm_min_epu8(a, b), a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LeUVecI8x16, uint8_t, uint8_t, 16, X <= Y, _mm_cmpeq_epi8(_mm_min_epu8(a, b), a))
+WASM2C_SIMD_COMPARE_X86(__GeUVecI8x16, uint8_t, uint8_t, 16, X >= Y, _mm_cmpeq_epi8(_mm_max_epu8(a, b), a))
+WASM2C_SIMD_COMPARE_X86(__EqVecI16x8, uint16_t, uint16_t, 8, X == Y, _mm_cmpeq_epi16(a, b))
+WASM2C_SIMD_COMPARE_X86(__NeVecI16x8, uint16_t, uint16_t, 8, X != Y, _mm_xor_si128(_mm_cmpeq_epi16(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LtSVecI16x8, int16_t, uint16_t, 8, X < Y, _mm_cmpgt_epi16(b, a))
+WASM2C_SIMD_COMPARE_X86(__GtSVecI16x8, int16_t, uint16_t, 8, X > Y, _mm_cmpgt_epi16(a, b))
+WASM2C_SIMD_COMPARE_X86(__LeSVecI16x8, int16_t, uint16_t, 8, X <= Y, _mm_xor_si128(_mm_cmpgt_epi16(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GeSVecI16x8, int16_t, uint16_t, 8, X >= Y, _mm_xor_si128(_mm_cmpgt_epi16(b, a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LtUVecI16x8, uint16_t, uint16_t, 8, X < Y, _mm_xor_si128(_mm_cmpeq_epi16(_mm_max_epu16(a, b), a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GtUVecI16x8, uint16_t, uint16_t, 8, X > Y, _mm_xor_si128(_mm_cmpeq_epi16(_mm_min_epu16(a, b), a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LeUVecI16x8, uint16_t, uint16_t, 8, X <= Y, _mm_cmpeq_epi16(_mm_min_epu16(a, b), a))
+WASM2C_SIMD_COMPARE_X86(__GeUVecI16x8, uint16_t, uint16_t, 8, X >= Y, _mm_cmpeq_epi16(_mm_max_epu16(a, b), a))
+WASM2C_SIMD_COMPARE_X86(__EqVecI32x4, uint32_t, uint32_t, 4, X == Y, _mm_cmpeq_epi32(a, b))
+WASM2C_SIMD_COMPARE_X86(__NeVecI32x4, uint32_t, uint32_t, 4, X != Y, _mm_xor_si128(_mm_cmpeq_epi32(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LtSVecI32x4, int32_t, uint32_t, 4, X < Y, _mm_cmpgt_epi32(b, a))
+WASM2C_SIMD_COMPARE_X86(__GtSVecI32x4, int32_t, uint32_t, 4, X > Y, _mm_cmpgt_epi32(a, b))
+WASM2C_SIMD_COMPARE_X86(__LeSVecI32x4, int32_t, uint32_t, 4, X <= Y, _mm_xor_si128(_mm_cmpgt_epi32(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GeSVecI32x4, int32_t, uint32_t, 4, X >= Y, _mm_xor_si128(_mm_cmpgt_epi32(b, a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LtUVecI32x4, uint32_t, uint32_t, 4, X < Y, _mm_xor_si128(_mm_cmpeq_epi32(_mm_max_epu32(a, b), a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GtUVecI32x4, uint32_t, uint32_t, 4, X > Y, _mm_xor_si128(_mm_cmpeq_epi32(_mm_min_epu32(a, b), a), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__LeUVecI32x4, uint32_t, uint32_t, 4, X <= Y, _mm_cmpeq_epi32(_mm_min_epu32(a, b), a))
+WASM2C_SIMD_COMPARE_X86(__GeUVecI32x4, uint32_t, uint32_t, 4, X >= Y, _mm_cmpeq_epi32(_mm_max_epu32(a, b), a))
+WASM2C_SIMD_COMPARE_X86(__EqVecI64x2, uint64_t, uint64_t, 2, X == Y, _mm_cmpeq_epi64(a, b))
+WASM2C_SIMD_COMPARE_X86(__NeVecI64x2, uint64_t, uint64_t, 2, X != Y, _mm_xor_si128(_mm_cmpeq_epi64(a, b), WASM2C_SIMD_ONES))
+#if defined(__SSE4_2__)
+WASM2C_SIMD_COMPARE_X86(__LtSVecI64x2, int64_t, uint64_t, 2, X < Y, _mm_cmpgt_epi64(b, a))
+WASM2C_SIMD_COMPARE_X86(__GtSVecI64x2, int64_t, uint64_t, 2, X > Y, _mm_cmpgt_epi64(a, b))
+WASM2C_SIMD_COMPARE_X86(__LeSVecI64x2, int64_t, uint64_t, 2, X <= Y, _mm_xor_si128(_mm_cmpgt_epi64(a, b), WASM2C_SIMD_ONES))
+WASM2C_SIMD_COMPARE_X86(__GeSVecI64x2, int64_t, uint64_t, 2, X >= Y, _mm_xor_si128(_mm_cmpgt_epi64(b, a), WASM2C_SIMD_ONES))
+#else
+WASM2C_SIMD_COMPARE(__LtSVecI64x2, int64_t, uint64_t, 2, X < Y)
+WASM2C_SIMD_COMPARE(__GtSVecI64x2, int64_t, uint64_t, 2, X > Y)
+WASM2C_SIMD_COMPARE(__LeSVecI64x2, int64_t, uint64_t, 2, X <= Y)
+WASM2C_SIMD_COMPARE(__GeSVecI64x2, int64_t, uint64_t, 2, X >= Y)
+#endif
+
+// lane summaries
+
+static inline int32_t wasm2c_simd_all_true(const uint8_t *lanes, int size)
+{
+    for (int i = 0; i < 16; i += size)
+    {
+        uint64_t lane = 0;
+        memcpy(&lane, lanes + i, size);
+        if (lane == 0)
+            return 0;
+    }
+    return 1;
+}
+#if WASM2C_SIMD_SSE
+static inline int32_t __AllTrueVecI8x16(v128 a) { return _mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128())) == 0; }
+static inline int32_t __AllTrueVecI16x8(v128 a) { return _mm_movemask_epi8(_mm_cmpeq_epi16(a, _mm_setzero_si128())) == 0; }
+static inline int32_t __AllTrueVecI32x4(v128 a) { return _mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_setzero_si128())) == 0; }
+static inline int32_t __AllTrueVecI64x2(v128 a) { return _mm_movemask_epi8(_mm_cmpeq_epi64(a, _mm_setzero_si128())) == 0; }
+static inline int32_t __BitmaskVecI8x16(v128 a) { return _mm_movemask_epi8(a); }
+static inline int32_t __BitmaskVecI16x8(v128 a) { return _mm_movemask_epi8(_mm_packs_epi16(a, _mm_setzero_si128())); }
+static inline int32_t __BitmaskVecI32x4(v128 a) { return _mm_movemask_ps(_mm_castsi128_ps(a)); }
+static inline int32_t __BitmaskVecI64x2(v128 a) { return _mm_movemask_pd(_mm_castsi128_pd(a)); }
+#else
+#define WASM2C_SIMD_BITMASK(name, type, count)   \
+    static inline int32_t name(v128 a)           \
+    {                                            \
+        WASM2C_SIMD_LANES(type, count, x, a);    \
+        int32_t r = 0;                           \
+        for (int i = 0; i < count; i++)          \
+            r |= (x[i] < 0) << i;                \
+        return r;                                \
+    }
+static inline int32_t __AllTrueVecI8x16(v128 a) { return wasm2c_simd_all_true((const uint8_t *)&a, 1); }
+static inline int32_t __AllTrueVecI16x8(v128 a) { return wasm2c_simd_all_true((const uint8_t *)&a, 2); }
+static inline int32_t __AllTrueVecI32x4(v128 a) { return wasm2c_simd_all_true((const uint8_t *)&a, 4); }
+static inline int32_t __AllTrueVecI64x2(v128 a) { return wasm2c_simd_all_true((const uint8_t *)&a, 8); }
+WASM2C_SIMD_BITMASK(__BitmaskVecI8x16, int8_t, 16)
+WASM2C_SIMD_BITMASK(__BitmaskVecI16x8, int16_t, 8)
+WASM2C_SIMD_BITMASK(__BitmaskVecI32x4, int32_t, 4)
+WASM2C_SIMD_BITMASK(__BitmaskVecI64x2, int64_t, 2)
+#endif
+static inline v128 __PopcntVecI8x16(v128 a)
+{
+#if WASM2C_SIMD_SSE
+    // bits set in each nibble, looked up with pshufb
+    __m128i table = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    __m128i nibbles = _mm_set1_epi8(0x0f);
+    __m128i low = _mm_shuffle_epi8(table, _mm_and_si128(a, nibbles));
+    __m128i high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(a, 4), nibbles));
+    return _mm_add_epi8(low, high);
+#else
+    WASM2C_SIMD_LANES(uint8_t, 16, x, a);
+    uint8_t r[16];
+    for (int i = 0; i < 16; i++)
+    {
+        uint8_t bits = x[i];
+        r[i] = 0;
+        for (; bits != 0; bits &= bits - 1)
+            r[i]++;
+    }
+    WASM2C_SIMD_RESULT(r);
+#endif
+}
+
+// float arithmetic
+
+WASM2C_SIMD_BINARY_X86(__AddVecF32x4, float, 4, X + Y, WASM2C_SIMD_FROM_F32(_mm_add_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_BINARY_X86(__SubVecF32x4, float, 4, X - Y, WASM2C_SIMD_FROM_F32(_mm_sub_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_BINARY_X86(__MulVecF32x4, float, 4, X * Y, WASM2C_SIMD_FROM_F32(_mm_mul_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_BINARY_X86(__DivVecF32x4, float, 4, X / Y, WASM2C_SIMD_FROM_F32(_mm_div_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_BINARY_X86(__AddVecF64x2, double, 2, X + Y, WASM2C_SIMD_FROM_F64(_mm_add_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_BINARY_X86(__SubVecF64x2, double, 2, X - Y, WASM2C_SIMD_FROM_F64(_mm_sub_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_BINARY_X86(__MulVecF64x2, double, 2, X * Y, WASM2C_SIMD_FROM_F64(_mm_mul_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_BINARY_X86(__DivVecF64x2, double, 2, X / Y, WASM2C_SIMD_FROM_F64(_mm_div_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_UNARY_X86(__SqrtVecF32x4, float, 4, sqrtf(X), WASM2C_SIMD_FROM_F32(_mm_sqrt_ps(WASM2C_SIMD_F32(a))))
+WASM2C_SIMD_UNARY_X86(__SqrtVecF64x2, double, 2, sqrt(X), WASM2C_SIMD_FROM_F64(_mm_sqrt_pd(WASM2C_SIMD_F64(a))))
+WASM2C_SIMD_UNARY_X86(__CeilVecF32x4, float, 4, ceilf(X), WASM2C_SIMD_FROM_F32(_mm_round_ps(WASM2C_SIMD_F32(a), _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__FloorVecF32x4, float, 4, floorf(X), WASM2C_SIMD_FROM_F32(_mm_round_ps(WASM2C_SIMD_F32(a), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__TruncVecF32x4, float, 4, truncf(X), WASM2C_SIMD_FROM_F32(_mm_round_ps(WASM2C_SIMD_F32(a), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__NearestVecF32x4, float, 4, nearbyintf(X), WASM2C_SIMD_FROM_F32(_mm_round_ps(WASM2C_SIMD_F32(a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__CeilVecF64x2, double, 2, ceil(X), WASM2C_SIMD_FROM_F64(_mm_round_pd(WASM2C_SIMD_F64(a), _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__FloorVecF64x2, double, 2, floor(X), WASM2C_SIMD_FROM_F64(_mm_round_pd(WASM2C_SIMD_F64(a), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__TruncVecF64x2, double, 2, trunc(X), WASM2C_SIMD_FROM_F64(_mm_round_pd(WASM2C_SIMD_F64(a), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)))
+WASM2C_SIMD_UNARY_X86(__NearestVecF64x2, double, 2, nearbyint(X), WASM2C_SIMD_FROM_F64(_mm_round_pd(WASM2C_SIMD_F64(a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)))
+// abs and neg only touch the sign bit, also of NaNs
+WASM2C_SIMD_UNARY_X86(__AbsVecF32x4, uint32_t, 4, X & 0x7fffffffu, _mm_and_si128(a, _mm_set1_epi32(0x7fffffff)))
+WASM2C_SIMD_UNARY_X86(__NegVecF32x4, uint32_t, 4, X ^ 0x80000000u, _mm_xor_si128(a, _mm_set1_epi32(INT32_MIN)))
+WASM2C_SIMD_UNARY_X86(__AbsVecF64x2, uint64_t, 2, X & 0x7fffffffffffffffull, _mm_and_si128(a, _mm_set1_epi64x(INT64_MAX)))
+WASM2C_SIMD_UNARY_X86(__NegVecF64x2, uint64_t, 2, X ^ 0x8000000000000000ull, _mm_xor_si128(a, _mm_set1_epi64x(INT64_MIN)))
+// pmin and pmax are exactly what minps and maxps do with swapped operands
+WASM2C_SIMD_BINARY_X86(__PMinVecF32x4, float, 4, Y < X ? Y : X, WASM2C_SIMD_FROM_F32(_mm_min_ps(WASM2C_SIMD_F32(b), WASM2C_SIMD_F32(a))))
+WASM2C_SIMD_BINARY_X86(__PMaxVecF32x4, float, 4, X < Y ? Y : X, WASM2C_SIMD_FROM_F32(_mm_max_ps(WASM2C_SIMD_F32(b), WASM2C_SIMD_F32(a))))
+WASM2C_SIMD_BINARY_X86(__PMinVecF64x2, double, 2, Y < X ? Y : X, WASM2C_SIMD_FROM_F64(_mm_min_pd(WASM2C_SIMD_F64(b), WASM2C_SIMD_F64(a))))
+WASM2C_SIMD_BINARY_X86(__PMaxVecF64x2, double, 2, X < Y ? Y : X, WASM2C_SIMD_FROM_F64(_mm_max_pd(WASM2C_SIMD_F64(b), WASM2C_SIMD_F64(a))))
+
+// min and max propagate NaN and order -0 below +0, which minps and maxps do
+// not. both operand orders are combined and NaNs canonicalized
+#if WASM2C_SIMD_SSE
+static inline v128 __MinVecF32x4(v128 a, v128 b)
+{
+    __m128 x = _mm_min_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b));
+    __m128 y = _mm_min_ps(WASM2C_SIMD_F32(b), WASM2C_SIMD_F32(a));
+    x = _mm_or_ps(x, y);
+    y = _mm_cmpunord_ps(y, x);
+    x = _mm_or_ps(x, y);
+    y = _mm_castsi128_ps(_mm_srli_epi32(_mm_castps_si128(y), 10));
+    return WASM2C_SIMD_FROM_F32(_mm_andnot_ps(y, x));
+}
+static inline v128 __MaxVecF32x4(v128 a, v128 b)
+{
+    __m128 x = _mm_max_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b));
+    __m128 y = _mm_max_ps(WASM2C_SIMD_F32(b), WASM2C_SIMD_F32(a));
+    y = _mm_xor_ps(y, x);
+    x = _mm_or_ps(x, y);
+    x = _mm_sub_ps(x, y);
+    y = _mm_cmpunord_ps(y, x);
+    y = _mm_castsi128_ps(_mm_srli_epi32(_mm_castps_si128(y), 10));
+    return WASM2C_SIMD_FROM_F32(_mm_andnot_ps(y, x));
+}
+static inline v128 __MinVecF64x2(v128 a, v128 b)
+{
+    __m128d x = _mm_min_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b));
+    __m128d y = _mm_min_pd(WASM2C_SIMD_F64(b), WASM2C_SIMD_F64(a));
+    x = _mm_or_pd(x, y);
+    y = _mm_cmpunord_pd(y, x);
+    x = _mm_or_pd(x, y);
+    y = _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(y), 13));
+    return WASM2C_SIMD_FROM_F64(_mm_andnot_pd(y, x));
+}
+static inline v128 __MaxVecF64x2(v128 a, v128 b)
+{
+    __m128d x = _mm_max_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b));
+    __m128d y = _mm_max_pd(WASM2C_SIMD_F64(b), WASM2C_SIMD_F64(a));
+    y = _mm_xor_pd(y, x);
+    x = _mm_or_pd(x, y);
+    x = _mm_sub_pd(x, y);
+    y = _mm_cmpunord_pd(y, x);
+    y = _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(y), 13));
+    return WASM2C_SIMD_FROM_F64(_mm_andnot_pd(y, x));
+}
+#else
+WASM2C_SIMD_BINARY(__MinVecF32x4, float, 4, wasm2c_simd_minf(X, Y))
+WASM2C_SIMD_BINARY(__MaxVecF32x4, float, 4, wasm2c_simd_maxf(X, Y))
+WASM2C_SIMD_BINARY(__MinVecF64x2, double, 2, wasm2c_simd_min(X, Y))
+WASM2C_SIMD_BINARY(__MaxVecF64x2, double, 2, wasm2c_simd_max(X, Y))
+#endif
+
+// float comparisons, all ordered except ne
+
+WASM2C_SIMD_COMPARE_X86(__EqVecF32x4, float, uint32_t, 4, X == Y, WASM2C_SIMD_FROM_F32(_mm_cmpeq_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_COMPARE_X86(__NeVecF32x4, float, uint32_t, 4, X != Y, WASM2C_SIMD_FROM_F32(_mm_cmpneq_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_COMPARE_X86(__LtVecF32x4, float, uint32_t, 4, X < Y, WASM2C_SIMD_FROM_F32(_mm_cmplt_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_COMPARE_X86(__GtVecF32x4, float, uint32_t, 4, X > Y, WASM2C_SIMD_FROM_F32(_mm_cmpgt_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_COMPARE_X86(__LeVecF32x4, float, uint32_t, 4, X <= Y, WASM2C_SIMD_FROM_F32(_mm_cmple_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_COMPARE_X86(__GeVecF32x4, float, uint32_t, 4, X >= Y, WASM2C_SIMD_FROM_F32(_mm_cmpge_ps(WASM2C_SIMD_F32(a), WASM2C_SIMD_F32(b))))
+WASM2C_SIMD_COMPARE_X86(__EqVecF64x2, double, uint64_t, 2, X == Y, WASM2C_SIMD_FROM_F64(_mm_cmpeq_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_COMPARE_X86(__NeVecF64x2, double, uint64_t, 2, X != Y, WASM2C_SIMD_FROM_F64(_mm_cmpneq_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_COMPARE_X86(__LtVecF64x2, double, uint64_t, 2, X < Y, WASM2C_SIMD_FROM_F64(_mm_cmplt_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_COMPARE_X86(__GtVecF64x2, double, uint64_t, 2, X > Y, WASM2C_SIMD_FROM_F64(_mm_cmpgt_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_COMPARE_X86(__LeVecF64x2, double, uint64_t, 2, X <= Y, WASM2C_SIMD_FROM_F64(_mm_cmple_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+WASM2C_SIMD_COMPARE_X86(__GeVecF64x2, double, uint64_t, 2, X >= Y, WASM2C_SIMD_FROM_F64(_mm_cmpge_pd(WASM2C_SIMD_F64(a), WASM2C_SIMD_F64(b))))
+
+// widening and narrowing. the scalar versions read from lane `first` on
+
+#define WASM2C_SIMD_EXTEND(name, fromType, toType, count, first) \
+    static inline v128 name(v128 a)                              \
+    {                                                            \
+        WASM2C_SIMD_LANES(fromType, count * 2, x, a);            \
+        toType r[count];                                         \
+        for (int i = 0; i < count; i++)                          \
+            r[i] = (toType)x[(first) + i];                       \
+        WASM2C_SIMD_RESULT(r);                                   \
+    }
+#define WASM2C_SIMD_NARROW(name, fromType, toType, saturate)       \
+    static inline v128 name(v128 a, v128 b)                        \
+    {                                                              \
+        WASM2C_SIMD_LANES(fromType, 16 / sizeof(fromType), x, a);  \
+        WASM2C_SIMD_LANES(fromType, 16 / sizeof(fromType), y, b);  \
+        toType r[16 / sizeof(toType)];                             \
+        for (int i = 0; i < (int)(16 / sizeof(fromType)); i++)     \
+        {                                                          \
+            r[i] = saturate(x[i]);                                 \
+            r[i + 16 / sizeof(fromType)] = saturate(y[i]);         \
+        }                                                          \
+        WASM2C_SIMD_RESULT(r);                                     \
+    }
+#if WASM2C_SIMD_SSE
+static inline v128 __ExtendLowSVecI8x16ToVecI16x8(v128 a) { return _mm_cvtepi8_epi16(a); }
+static inline v128 __ExtendHighSVecI8x16ToVecI16x8(v128 a) { return _mm_cvtepi8_epi16(_mm_srli_si128(a, 8)); }
+static inline v128 __ExtendLowUVecI8x16ToVecI16x8(v128 a) { return _mm_cvtepu8_epi16(a); }
+static inline v128 __ExtendHighUVecI8x16ToVecI16x8(v128 a) { return _mm_cvtepu8_epi16(_mm_srli_si128(a, 8)); }
+static inline v128 __ExtendLowSVecI16x8ToVecI32x4(v128 a) { return _mm_cvtepi16_epi32(a); }
+static inline v128 __ExtendHighSVecI16x8ToVecI32x4(v128 a) { return _mm_cvtepi16_epi32(_mm_srli_si128(a, 8)); }
+static inline v128 __ExtendLowUVecI16x8ToVecI32x4(v128 a) { return _mm_cvtepu16_epi32(a); }
+static inline v128 __ExtendHighUVecI16x8ToVecI32x4(v128 a) { return _mm_cvtepu16_epi32(_mm_srli_si128(a, 8)); }
+static inline v128 __ExtendLowSVecI32x4ToVecI64x2(v128 a) { return _mm_cvtepi32_epi64(a); }
+static inline v128 __ExtendHighSVecI32x4ToVecI64x2(v128 a) { return _mm_cvtepi32_epi64(_mm_srli_si128(a, 8)); }
+static inline v128 __ExtendLowUVecI32x4ToVecI64x2(v128 a) { return _mm_cvtepu32_epi64(a); }
+static inline v128 __ExtendHighUVecI32x4ToVecI64x2(v128 a) { return _mm_cvtepu32_epi64(_mm_srli_si128(a, 8)); }
+static inline v128 __NarrowSVecI16x8ToVecI8x16(v128 a, v128 b) { return _mm_packs_epi16(a, b); }
+static inline v128 __NarrowUVecI16x8ToVecI8x16(v128 a, v128 b) { return _mm_packus_epi16(a, b); }
+static inline v128 __NarrowSVecI32x4ToVecI16x8(v128 a, v128 b) { return _mm_packs_epi32(a, b); }
+static inline v128 __NarrowUVecI32x4ToVecI16x8(v128 a, v128 b) { return _mm_packus_epi32(a, b); }
+#else
+WASM2C_SIMD_EXTEND(__ExtendLowSVecI8x16ToVecI16x8, int8_t, int16_t, 8, 0)
+WASM2C_SIMD_EXTEND(__ExtendHighSVecI8x16ToVecI16x8, int8_t, int16_t, 8, 8)
+WASM2C_SIMD_EXTEND(__ExtendLowUVecI8x16ToVecI16x8, uint8_t, uint16_t, 8, 0)
+WASM2C_SIMD_EXTEND(__ExtendHighUVecI8x16ToVecI16x8, uint8_t, uint16_t, 8, 8)
+WASM2C_SIMD_EXTEND(__ExtendLowSVecI16x8ToVecI32x4, int16_t, int32_t, 4, 0)
+WASM2C_SIMD_EXTEND(__ExtendHighSVecI16x8ToVecI32x4, int16_t, int32_t, 4, 4)
+WASM2C_SIMD_EXTEND(__ExtendLowUVecI16x8ToVecI32x4, uint16_t, uint32_t, 4, 0)
+WASM2C_SIMD_EXTEND(__ExtendHighUVecI16x8ToVecI32x4, uint16_t, uint32_t, 4, 4)
+WASM2C_SIMD_EXTEND(__ExtendLowSVecI32x4ToVecI64x2, int32_t, int64_t, 2, 0)
+WASM2C_SIMD_EXTEND(__ExtendHighSVecI32x4ToVecI64x2, int32_t, int64_t, 2, 2)
+WASM2C_SIMD_EXTEND(__ExtendLowUVecI32x4ToVecI64x2, uint32_t, uint64_t, 2, 0)
+WASM2C_SIMD_EXTEND(__ExtendHighUVecI32x4ToVecI64x2, uint32_t, uint64_t, 2, 2)
+WASM2C_SIMD_NARROW(__NarrowSVecI16x8ToVecI8x16, int16_t, int8_t, wasm2c_simd_saturate_s8)
+WASM2C_SIMD_NARROW(__NarrowUVecI16x8ToVecI8x16, int16_t, uint8_t, wasm2c_simd_saturate_u8)
+WASM2C_SIMD_NARROW(__NarrowSVecI32x4ToVecI16x8, int32_t, int16_t, wasm2c_simd_saturate_s16)
+WASM2C_SIMD_NARROW(__NarrowUVecI32x4ToVecI16x8, int32_t, uint16_t, wasm2c_simd_saturate_u16)
+#endif
+
+// extended multiplies widen both operands first, and on x86 the 64 bit
+// lane products come from pmuldq/pmuludq
+#define WASM2C_SIMD_EXTMUL(name, extend, multiply)         \
+    static inline v128 name(v128 a, v128 b)                \
+    {                                                      \
+        return multiply(extend(a), extend(b));             \
+    }
+#if WASM2C_SIMD_SSE
+#define WASM2C_SIMD_MUL_S64(a, b) _mm_mul_epi32(a, b)
+#define WASM2C_SIMD_MUL_U64(a, b) _mm_mul_epu32(a, b)
+#else
+#define WASM2C_SIMD_MUL_S64(a, b) __MulVecI64x2(a, b)
+#define WASM2C_SIMD_MUL_U64(a, b) __MulVecI64x2(a, b)
+#endif
+WASM2C_SIMD_EXTMUL(__ExtMulLowSVecI16x8, __ExtendLowSVecI8x16ToVecI16x8, __MulVecI16x8)
+WASM2C_SIMD_EXTMUL(__ExtMulHighSVecI16x8, __ExtendHighSVecI8x16ToVecI16x8, __MulVecI16x8)
+WASM2C_SIMD_EXTMUL(__ExtMulLowUVecI16x8, __ExtendLowUVecI8x16ToVecI16x8, __MulVecI16x8)
+WASM2C_SIMD_EXTMUL(__ExtMulHighUVecI16x8, __ExtendHighUVecI8x16ToVecI16x8, __MulVecI16x8)
+WASM2C_SIMD_EXTMUL(__ExtMulLowSVecI32x4, __ExtendLowSVecI16x8ToVecI32x4, __MulVecI32x4)
+WASM2C_SIMD_EXTMUL(__ExtMulHighSVecI32x4, __ExtendHighSVecI16x8ToVecI32x4, __MulVecI32x4)
+WASM2C_SIMD_EXTMUL(__ExtMulLowUVecI32x4, __ExtendLowUVecI16x8ToVecI32x4, __MulVecI32x4)
+WASM2C_SIMD_EXTMUL(__ExtMulHighUVecI32x4, __ExtendHighUVecI16x8ToVecI32x4, __MulVecI32x4)
+WASM2C_SIMD_EXTMUL(__ExtMulLowSVecI64x2, __ExtendLowSVecI32x4ToVecI64x2, WASM2C_SIMD_MUL_S64)
+WASM2C_SIMD_EXTMUL(__ExtMulHighSVecI64x2, __ExtendHighSVecI32x4ToVecI64x2, WASM2C_SIMD_MUL_S64)
+WASM2C_SIMD_EXTMUL(__ExtMulLowUVecI64x2, __ExtendLowUVecI32x4ToVecI64x2, WASM2C_SIMD_MUL_U64)
+WASM2C_SIMD_EXTMUL(__ExtMulHighUVecI64x2, __ExtendHighUVecI32x4ToVecI64x2, WASM2C_SIMD_MUL_U64)
+
+#define WASM2C_SIMD_PAIRWISE(name, fromType, toType, count)  \
+    static inline v128 name(v128 a)                          \
+    {                                                        \
+        WASM2C_SIMD_LANES(fromType, count * 2, x, a);        \
+        toType r[count];                                     \
+        for (int i = 0; i < count; i++)                      \
+            r[i] = (toType)x[2 * i] + (toType)x[2 * i + 1];  \
+        WASM2C_SIMD_RESULT(r);                               \
+    }
+#if WASM2C_SIMD_SSE
+static inline v128 __ExtAddPairwiseSVecI8x16ToI16x8(v128 a) { return _mm_maddubs_epi16(_mm_set1_epi8(1), a); }
+static inline v128 __ExtAddPairwiseUVecI8x16ToI16x8(v128 a) { return _mm_maddubs_epi16(a, _mm_set1_epi8(1)); }
+static inline v128 __ExtAddPairwiseSVecI16x8ToI32x4(v128 a) { return _mm_madd_epi16(a, _mm_set1_epi16(1)); }
+#else
+WASM2C_SIMD_PAIRWISE(__ExtAddPairwiseSVecI8x16ToI16x8, int8_t, int16_t, 8)
+WASM2C_SIMD_PAIRWISE(__ExtAddPairwiseUVecI8x16ToI16x8, uint8_t, uint16_t, 8)
+WASM2C_SIMD_PAIRWISE(__ExtAddPairwiseSVecI16x8ToI32x4, int16_t, int32_t, 4)
+#endif
+WASM2C_SIMD_PAIRWISE(__ExtAddPairwiseUVecI16x8ToI32x4, uint16_t, uint32_t, 4)
+
+// conversions between integer and float lanes. the saturating truncations
+// stay scalar on x86 as well, cvttps2dq does not saturate
+
+static inline v128 __TruncSatSVecF32x4ToVecI32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(float, 4, x, a);
+    int32_t r[4];
+    for (int i = 0; i < 4; i++)
+        r[i] = wasm2c_simd_trunc_sat_s(x[i]);
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __TruncSatUVecF32x4ToVecI32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(float, 4, x, a);
+    uint32_t r[4];
+    for (int i = 0; i < 4; i++)
+        r[i] = wasm2c_simd_trunc_sat_u(x[i]);
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __TruncSatZeroSVecF64x2ToVecI32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(double, 2, x, a);
+    int32_t r[4] = {wasm2c_simd_trunc_sat_s(x[0]), wasm2c_simd_trunc_sat_s(x[1]), 0, 0};
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __TruncSatZeroUVecF64x2ToVecI32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(double, 2, x, a);
+    uint32_t r[4] = {wasm2c_simd_trunc_sat_u(x[0]), wasm2c_simd_trunc_sat_u(x[1]), 0, 0};
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __ConvertUVecI32x4ToVecF32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(uint32_t, 4, x, a);
+    float r[4] = {(float)x[0], (float)x[1], (float)x[2], (float)x[3]};
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __ConvertLowUVecI32x4ToVecF64x2(v128 a)
+{
+    WASM2C_SIMD_LANES(uint32_t, 4, x, a);
+    double r[2] = {(double)x[0], (double)x[1]};
+    WASM2C_SIMD_RESULT(r);
+}
+#if WASM2C_SIMD_SSE
+static inline v128 __ConvertSVecI32x4ToVecF32x4(v128 a) { return _mm_castps_si128(_mm_cvtepi32_ps(a)); }
+static inline v128 __ConvertLowSVecI32x4ToVecF64x2(v128 a) { return _mm_castpd_si128(_mm_cvtepi32_pd(a)); }
+static inline v128 __DemoteZeroVecF64x2ToVecF32x4(v128 a) { return _mm_castps_si128(_mm_cvtpd_ps(_mm_castsi128_pd(a))); }
+static inline v128 __PromoteLowVecF32x4ToVecF64x2(v128 a) { return _mm_castpd_si128(_mm_cvtps_pd(_mm_castsi128_ps(a))); }
+#else
+static inline v128 __ConvertSVecI32x4ToVecF32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(int32_t, 4, x, a);
+    float r[4] = {(float)x[0], (float)x[1], (float)x[2], (float)x[3]};
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __ConvertLowSVecI32x4ToVecF64x2(v128 a)
+{
+    WASM2C_SIMD_LANES(int32_t, 4, x, a);
+    double r[2] = {(double)x[0], (double)x[1]};
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __DemoteZeroVecF64x2ToVecF32x4(v128 a)
+{
+    WASM2C_SIMD_LANES(double, 2, x, a);
+    float r[4] = {(float)x[0], (float)x[1], 0, 0};
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __PromoteLowVecF32x4ToVecF64x2(v128 a)
+{
+    WASM2C_SIMD_LANES(float, 4, x, a);
+    double r[2] = {(double)x[0], (double)x[1]};
+    WASM2C_SIMD_RESULT(r);
+}
+#endif
+
+// memory. the address points into linear memory and has no alignment
+// guarantee
+
+static inline v128 __LoadVec128(const void *address)
+{
+#if WASM2C_SIMD_SSE
+    return _mm_loadu_si128((const __m128i *)address);
+#else
+    v128 result;
+    memcpy(&result, address, 16);
+    return result;
+#endif
+}
+static inline void __StoreVec128(void *address, v128 value)
+{
+#if WASM2C_SIMD_SSE
+    _mm_storeu_si128((__m128i *)address, value);
+#else
+    memcpy(address, &value, 16);
+#endif
+}
+static inline v128 __Load8SplatVec128(const void *address)
+{
+    uint8_t x;
+    memcpy(&x, address, 1);
+    return __SplatVecI8x16(x);
+}
+static inline v128 __Load16SplatVec128(const void *address)
+{
+    uint16_t x;
+    memcpy(&x, address, 2);
+    return __SplatVecI16x8(x);
+}
+static inline v128 __Load32SplatVec128(const void *address)
+{
+    int32_t x;
+    memcpy(&x, address, 4);
+    return __SplatVecI32x4(x);
+}
+static inline v128 __Load64SplatVec128(const void *address)
+{
+    int64_t x;
+    memcpy(&x, address, 8);
+    return __SplatVecI64x2(x);
+}
+static inline v128 __Load32ZeroVec128(const void *address)
+{
+    uint32_t r[4] = {0, 0, 0, 0};
+    memcpy(r, address, 4);
+    WASM2C_SIMD_RESULT(r);
+}
+static inline v128 __Load64ZeroVec128(const void *address)
+{
+    uint64_t r[2] = {0, 0};
+    memcpy(r, address, 8);
+    WASM2C_SIMD_RESULT(r);
+}
+#define WASM2C_SIMD_LOAD_EXTEND(name, extend)              \
+    static inline v128 name(const void *address)           \
+    {                                                      \
+        return extend(__Load64ZeroVec128(address));        \
+    }
+WASM2C_SIMD_LOAD_EXTEND(__Load8x8SVec128, __ExtendLowSVecI8x16ToVecI16x8)
+WASM2C_SIMD_LOAD_EXTEND(__Load8x8UVec128, __ExtendLowUVecI8x16ToVecI16x8)
+WASM2C_SIMD_LOAD_EXTEND(__Load16x4SVec128, __ExtendLowSVecI16x8ToVecI32x4)
+WASM2C_SIMD_LOAD_EXTEND(__Load16x4UVec128, __ExtendLowUVecI16x8ToVecI32x4)
+WASM2C_SIMD_LOAD_EXTEND(__Load32x2SVec128, __ExtendLowSVecI32x4ToVecI64x2)
+WASM2C_SIMD_LOAD_EXTEND(__Load32x2UVec128, __ExtendLowUVecI32x4ToVecI64x2)
+
+#define WASM2C_SIMD_LOAD_LANE(name, size)                               \
+    static inline v128 name(const void *address, v128 a, int lane)      \
+    {                                                                   \
+        memcpy((uint8_t *)&a + lane * size, address, size);             \
+        return a;                                                       \
+    }
+#define WASM2C_SIMD_STORE_LANE(name, size)                              \
+    static inline void name(void *address, v128 a, int lane)            \
+    {                                                                   \
+        memcpy(address, (const uint8_t *)&a + lane * size, size);       \
+    }
+WASM2C_SIMD_LOAD_LANE(__Load8LaneVec128, 1)
+WASM2C_SIMD_LOAD_LANE(__Load16LaneVec128, 2)
+WASM2C_SIMD_LOAD_LANE(__Load32LaneVec128, 4)
+WASM2C_SIMD_LOAD_LANE(__Load64LaneVec128, 8)
+WASM2C_SIMD_STORE_LANE(__Store8LaneVec128, 1)
+WASM2C_SIMD_STORE_LANE(__Store16LaneVec128, 2)
+WASM2C_SIMD_STORE_LANE(__Store32LaneVec128, 4)
+WASM2C_SIMD_STORE_LANE(__Store64LaneVec128, 8)
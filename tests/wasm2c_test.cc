@@ -0,0 +1,168 @@
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "wasm2c.h"
+#include "wasm_module_writer.h"
+
+// decompiles the binary through the library callbacks, returning false when
+// it cannot be decompiled
+bool DecompileToString(const std::vector<uint8_t> &binary, const Wasm2cOptions &options, std::string &output)
+{
+    Wasm2cCallbacks callbacks;
+    callbacks.output = [&output](std::string_view text) { output += text; };
+    callbacks.diagnostic = [](std::string_view message) { std::cout << "    " << message << std::endl; };
+
+    return DecompileWasm2c(std::vector<char>(binary.begin(), binary.end()), "wasm2c_test.c", options, callbacks);
+}
+// one subtraction chain nested 100k deep, which overflows the native stack
+// of an emitter recursing once per expression. the C is compared against
+// the text of a recursive descent over the same tree, built here by hand:
+// every left operand is a subtraction and so parenthesized
+bool TestDeepExpression()
+{
+    constexpr size_t depth = 100000;
+
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+
+    std::vector<uint8_t> code;
+    WriteI32Const(code, 0);
+    for (size_t i = 1; i < depth; i++)
+    {
+        WriteI32Const(code, int32_t(i % 1000));
+        code.push_back(0x6b);
+    }
+    module.Export(module.AddFunction(type, 0, code));
+
+    std::string expected = "return " + std::string(depth - 2, '(') + "0 - 1";
+    for (size_t i = 2; i < depth; i++)
+        expected += ") - " + std::to_string(i % 1000);
+    expected += ";\n";
+
+    for (bool stream : {false, true})
+    {
+        Wasm2cOptions options;
+        options.stream = stream;
+
+        std::string output;
+        if (!DecompileToString(module.Finish(), options, output))
+            return false;
+        if (output.find(expected) == std::string::npos)
+        {
+            std::cout << "    the " << (stream ? "streamed " : "") << "output differs from the recursive descent" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+// an add of two params for every value type, each of which has to come out
+// as a C addition
+bool TestAdditions()
+{
+    const std::pair<uint8_t, uint8_t> additions[] = {
+        {0x7f, 0x6a},
+        {0x7e, 0x7c},
+        {0x7d, 0x92},
+        {0x7c, 0xa0},
+    };
+
+    WasmModuleWriter module;
+    for (const auto &[valueType, opcode] : additions)
+    {
+        std::vector<uint8_t> code;
+        WriteIndexed(code, 0x20, 0);
+        WriteIndexed(code, 0x20, 1);
+        code.push_back(opcode);
+        module.Export(module.AddFunction(module.AddType(2, true, valueType), 0, code));
+    }
+
+    std::string output;
+    if (!DecompileToString(module.Finish(), {}, output))
+        return false;
+
+    size_t count = 0;
+    for (size_t found = output.find("return v0 + v1;"); found != std::string::npos; found = output.find("return v0 + v1;", found + 1))
+        count++;
+    if (count != std::size(additions))
+    {
+        std::cout << "    " << count << " of " << std::size(additions) << " additions are written as v0 + v1" << std::endl;
+        return false;
+    }
+    return true;
+}
+// a br_table jumping out of the then arm of an if with an else, which
+// binaryen makes a named block. the label its goto lands on has to stay
+// inside the braces of that block, or the else is left without its if
+bool TestBranchTableToIfArm()
+{
+    WasmModuleWriter module;
+    uint32_t type = module.AddType(1, true);
+
+    std::vector<uint8_t> code = {0x02, 0x40};
+    WriteIndexed(code, 0x20, 0);
+    code.insert(code.end(), {0x04, 0x40});
+    WriteIndexed(code, 0x20, 0);
+    // br_table to the if, then the block, and the block by default
+    code.insert(code.end(), {0x0e, 0x02, 0x00, 0x01, 0x01});
+    code.push_back(0x05);
+    WriteI32Const(code, 5);
+    code.insert(code.end(), {0x0f, 0x0b});
+    WriteI32Const(code, 6);
+    code.insert(code.end(), {0x0f, 0x0b});
+    WriteI32Const(code, 7);
+    module.Export(module.AddFunction(type, 0, code));
+
+    std::string output;
+    if (!DecompileToString(module.Finish(), {}, output))
+        return false;
+    if (output.find("goto ") == std::string::npos || output.find("else") == std::string::npos)
+    {
+        std::cout << "    the br_table or the else is missing" << std::endl;
+        return false;
+    }
+    for (size_t label = output.find("_end:;"); label != std::string::npos; label = output.find("_end:;", label + 1))
+    {
+        size_t next = output.find_first_not_of(" \n", label + 6);
+        if (next == std::string::npos || output[next] != '}')
+        {
+            std::cout << "    a br_table label is not the last statement of its block" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+// an unknown pass name is reported and fails the decompilation, rather than
+// reaching binaryen, which exits the process
+bool TestUnknownPass()
+{
+    WasmModuleWriter module;
+    std::vector<uint8_t> code;
+    WriteIndexed(code, 0x20, 0);
+    module.Export(module.AddFunction(module.AddType(1, true), 0, code));
+
+    Wasm2cOptions options;
+    options.passes = {"no-such-pass"};
+    std::string output;
+    return !DecompileToString(module.Finish(), options, output) && output.empty();
+}
+int32_t main()
+{
+    const std::pair<const char *, bool (*)()> tests[] = {
+        {"deep expression", TestDeepExpression},
+        {"additions", TestAdditions},
+        {"br_table to an if arm", TestBranchTableToIfArm},
+        {"unknown pass", TestUnknownPass},
+    };
+
+    bool succeeded = true;
+    for (const auto &[name, test] : tests)
+    {
+        bool passed = test();
+        std::cout << (passed ? "passed " : "FAILED ") << name << std::endl;
+        succeeded &= passed;
+    }
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,4750 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ir/utils.h>
+#include <pass.h>
+#include <wasm-binary.h>
+#include <wasm-features.h>
+#include <wasm-traversal.h>
+
+#include "wasm2c.h"
+
+// how much of the code section a streamed chunk holds
+constexpr size_t streamChunkBytes = 4 << 20;
+// the function table as seen by call_indirect. it is emitted as one typed
+// table per signature that is called indirectly
+struct TableLayout
+{
+    size_t size = 0;
+    // whether every element segment has a constant offset, so slots holds
+    // the whole table and it is initialized statically
+    bool constant = true;
+    // the function in each slot, null for empty slots
+    std::vector<wasm::Function *> slots;
+    // the signatures called indirectly, by signature name
+    std::map<std::string, wasm::Signature> signatures;
+};
+// the globals never written after their initialization, by name, and the
+// value reads of them are replaced with: a Const, or a GlobalGet of the
+// imported global they were initialized from
+using ConstantGlobals = std::unordered_map<std::string, wasm::Expression *>;
+// the runtime counts --profile gives for one function
+struct FunctionProfile
+{
+    // whether the profile has a function line for it, without which the
+    // function was not covered rather than never called
+    bool counted = false;
+    uint64_t calls = 0;
+    // how often each conditional branch went each way, numbered in the
+    // order the if and br_if opcodes appear in the function's wasm code
+    std::vector<std::pair<uint64_t, uint64_t>> branches;
+};
+// where a function goes in the output, and whether the C compiler is told
+// it is hot or cold
+enum class FunctionHeat
+{
+    Unknown,
+    Hot,
+    Cold,
+};
+// the value the condition of a branch almost always has according to the
+// profile, or -1 when it has no clear bias or was never run
+int GetBranchExpectation(const FunctionProfile *profile, size_t branch)
+{
+    constexpr double bias = 0.9;
+
+    if (profile == nullptr || branch >= profile->branches.size())
+        return -1;
+
+    auto [taken, notTaken] = profile->branches[branch];
+    if (taken + notTaken == 0)
+        return -1;
+    if (taken >= bias * (taken + notTaken))
+        return 1;
+    if (notTaken >= bias * (taken + notTaken))
+        return 0;
+    return -1;
+}
+struct EmitterContext
+{
+    size_t expressionDepth = 0;
+    MemoryMode memoryMode = MemoryMode::None;
+    const TableLayout *table = nullptr;
+    const ConstantGlobals *constantGlobals = nullptr;
+    const FunctionProfile *profile = nullptr;
+    // the profile index of every if and br_if, see BranchOrderScanner
+    std::unordered_map<wasm::Expression *, size_t> branchIndices;
+    // the blocks and loops a br_table jumps to, which get a label for its
+    // gotos: a block at its end and a loop at its start
+    std::unordered_set<std::string_view> switchTargets;
+    std::unordered_set<std::string_view> loops;
+};
+// where messages for the user go: a callback of the library, or stdout
+// for the command line. every thread reports to the diagnostics of the
+// decompilation it works on, installed with ScopedDiagnostics, so several
+// decompilations can run at once
+class Diagnostics
+{
+public:
+    Diagnostics(std::function<void(std::string_view)> callback) : callback(std::move(callback))
+    {
+    }
+
+    // the emitting threads may report at the same time
+    void Report(std::string_view message)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        callback(message);
+    }
+
+private:
+    std::function<void(std::string_view)> callback;
+    std::mutex mutex;
+};
+thread_local Diagnostics *currentDiagnostics = nullptr;
+class ScopedDiagnostics
+{
+public:
+    ScopedDiagnostics(Diagnostics *diagnostics) : previous(currentDiagnostics)
+    {
+        currentDiagnostics = diagnostics;
+    }
+    ~ScopedDiagnostics()
+    {
+        currentDiagnostics = previous;
+    }
+
+private:
+    Diagnostics *previous;
+};
+// reports the parts written one after the other as one message
+template <typename... Parts>
+void Report(const Parts &...parts)
+{
+    std::ostringstream message;
+    (message << ... << parts);
+
+    if (currentDiagnostics != nullptr)
+        currentDiagnostics->Report(message.str());
+    else
+        std::cout << message.str() << std::endl;
+}
+// destination for generated C. the generators write each piece as soon as
+// it is finished instead of building the whole program in memory
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    virtual void Write(std::string_view data) = 0;
+};
+class FileOutputSink : public OutputSink
+{
+public:
+    FileOutputSink(const std::string &path)
+        : fileStream(path, std::ios::binary)
+    {
+        if (!fileStream.is_open())
+        {
+            Report("could not open output file path ", path);
+            throw std::runtime_error("unable to open output file");
+        }
+    }
+
+    void Write(std::string_view data) override
+    {
+        fileStream.write(data.data(), data.size());
+    }
+
+private:
+    std::ofstream fileStream;
+};
+class CallbackOutputSink : public OutputSink
+{
+public:
+    CallbackOutputSink(const std::function<void(std::string_view)> &callback)
+        : callback(callback)
+    {
+    }
+
+    void Write(std::string_view data) override
+    {
+        callback(data);
+    }
+
+private:
+    const std::function<void(std::string_view)> &callback;
+};
+class StreamOutputSink : public OutputSink
+{
+public:
+    StreamOutputSink(std::ostream &stream)
+        : stream(stream)
+    {
+    }
+
+    void Write(std::string_view data) override
+    {
+        stream.write(data.data(), data.size());
+    }
+
+private:
+    std::ostream &stream;
+};
+// text buffer the emitter writes into. text goes into chunks that are
+// never moved once allocated, indentation is an integer level written from a
+// prebuilt table and numbers are formatted in place with std::to_chars, so
+// emitting an expression node does not allocate temporary strings
+class CodeWriter
+{
+public:
+    CodeWriter() = default;
+    CodeWriter(CodeWriter &&) = default;
+    CodeWriter &operator=(CodeWriter &&) = default;
+
+    CodeWriter &operator<<(std::string_view text)
+    {
+        while (!text.empty())
+        {
+            if (chunkUsed == chunkCapacity)
+                AddChunk(text.size());
+
+            size_t count = std::min(text.size(), chunkCapacity - chunkUsed);
+            std::memcpy(chunks.back().get() + chunkUsed, text.data(), count);
+            chunkUsed += count;
+            size += count;
+            text.remove_prefix(count);
+        }
+        return *this;
+    }
+    CodeWriter &operator<<(const char *text)
+    {
+        return *this << std::string_view(text);
+    }
+    CodeWriter &operator<<(char character)
+    {
+        if (chunkUsed == chunkCapacity)
+            AddChunk(1);
+
+        chunks.back()[chunkUsed++] = character;
+        size++;
+        return *this;
+    }
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    CodeWriter &operator<<(Integer value)
+    {
+        // formatted straight into the current chunk when it has room
+        constexpr size_t maximumLength = 24;
+        if (chunkCapacity - chunkUsed >= maximumLength)
+        {
+            char *start = chunks.back().get() + chunkUsed;
+            size_t count = std::to_chars(start, start + maximumLength, value).ptr - start;
+            chunkUsed += count;
+            size += count;
+            return *this;
+        }
+
+        char buffer[maximumLength];
+        return *this << std::string_view(buffer, std::to_chars(buffer, buffer + maximumLength, value).ptr - buffer);
+    }
+
+    void Indent()
+    {
+        indentationLevel++;
+    }
+    void Dedent()
+    {
+        indentationLevel--;
+    }
+    CodeWriter &Indentation()
+    {
+        static const std::string_view table = "                                                                                                                                ";
+
+        size_t remaining = indentationLevel * 4;
+        while (remaining != 0)
+        {
+            size_t count = std::min(remaining, table.size());
+            *this << table.substr(0, count);
+            remaining -= count;
+        }
+        return *this;
+    }
+    // the name of local `index`, formatted once per writer
+    CodeWriter &Local(wasm::Index index)
+    {
+        if (index >= localNames.size())
+            localNames.resize(index + 1);
+
+        std::string &name = localNames[index];
+        if (name.empty())
+            name = "v" + std::to_string(index);
+
+        return *this << name;
+    }
+
+    char Back() const
+    {
+        return chunkUsed != 0 ? chunks.back()[chunkUsed - 1] : '\0';
+    }
+    size_t Size() const
+    {
+        return size;
+    }
+    void WriteTo(OutputSink &sink) const
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+            sink.Write(std::string_view(chunks[i].get(), i + 1 == chunks.size() ? chunkUsed : chunkSizes[i]));
+    }
+
+private:
+    void AddChunk(size_t minimumSize)
+    {
+        if (!chunks.empty())
+            chunkSizes.back() = chunkUsed;
+
+        // chunks grow geometrically so tiny functions stay cheap and huge
+        // ones do not end up with thousands of chunks
+        size_t capacity = std::clamp<size_t>(size, 1 << 10, 1 << 20);
+        capacity = std::max(capacity, std::min<size_t>(minimumSize, 1 << 20));
+
+        chunks.emplace_back(new char[capacity]);
+        chunkSizes.push_back(capacity);
+        chunkCapacity = capacity;
+        chunkUsed = 0;
+    }
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<size_t> chunkSizes;
+    size_t chunkCapacity = 0;
+    size_t chunkUsed = 0;
+    size_t size = 0;
+    size_t indentationLevel = 0;
+    std::vector<std::string> localNames;
+};
+
+wasm::Module *ParseWasm(const std::vector<char> &binaryData)
+{
+    wasm::FeatureSet features = wasm::FeatureSet::MVP | wasm::FeatureSet::SIMD | wasm::FeatureSet::BulkMemory;
+
+    wasm::Module *module = new wasm::Module;
+    // the optimization passes only use the features enabled on the module
+    module->features = features;
+    wasm::WasmBinaryBuilder parser(*module, features, binaryData);
+    parser.read();
+
+    return module;
+}
+// reads the framing of a wasm binary: sections, vectors and LEB128 numbers,
+// without decoding any instruction
+class WasmBinaryCursor
+{
+public:
+    WasmBinaryCursor(const std::vector<char> &binary, size_t position, size_t end) : position(position), end(end), binary(binary)
+    {
+    }
+    uint8_t Byte()
+    {
+        if (position >= end)
+            Malformed();
+        return uint8_t(binary[position++]);
+    }
+    uint64_t LEB()
+    {
+        uint64_t value = 0;
+        for (unsigned shift = 0;; shift += 7)
+        {
+            uint8_t byte = Byte();
+            if (shift < 64)
+                value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+            if (shift > 63)
+                Malformed();
+        }
+    }
+    void SkipLEB()
+    {
+        while ((Byte() & 0x80) != 0)
+            ;
+    }
+    void Skip(uint64_t size)
+    {
+        if (size > end - position)
+            Malformed();
+        position += size;
+    }
+    [[noreturn]] void Malformed() const
+    {
+        Report("malformed wasm binary at offset ", position);
+        throw std::runtime_error("malformed wasm binary");
+    }
+
+    size_t position;
+    size_t end;
+
+private:
+    const std::vector<char> &binary;
+};
+void WriteLEB(std::vector<char> &output, uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        output.push_back(char(value != 0 ? byte | 0x80 : byte));
+    } while (value != 0);
+}
+// the code section of a module parsed a chunk of functions at a time, so only
+// one chunk of function bodies is alive at once. each chunk is parsed from a
+// copy of the binary where the bodies outside the chunk are replaced by
+// `unreachable` and the data segments are empty, which keeps every function
+// and segment index as it is in the original. the skeleton holds the whole
+// module with every body replaced
+class StreamedCodeSection
+{
+public:
+    StreamedCodeSection(std::vector<char> binaryData, size_t chunkBytes)
+        : binary(std::move(binaryData))
+    {
+        WasmBinaryCursor cursor(binary, 0, binary.size());
+        cursor.Skip(8); // magic and version
+        while (cursor.position < binary.size())
+        {
+            Section section;
+            section.id = cursor.Byte();
+            uint64_t size = cursor.LEB();
+            section.begin = cursor.position;
+            cursor.Skip(size);
+            section.end = cursor.position;
+            if (section.id == customSection)
+            {
+                WasmBinaryCursor nameCursor(binary, section.begin, section.end);
+                uint64_t length = nameCursor.LEB();
+                size_t nameBegin = nameCursor.position;
+                nameCursor.Skip(length);
+                section.name = std::string_view(binary.data() + nameBegin, length);
+            }
+            else if (section.id == codeSection)
+                ReadBodies(section);
+            else if (section.id == dataSection)
+                emptiedData = EmptyDataSegments(section);
+            sections.push_back(section);
+        }
+
+        size_t chunkSize = 0;
+        for (size_t i = 0; i < bodies.size(); i++)
+        {
+            if (i == 0 || chunkSize >= chunkBytes)
+            {
+                chunkStarts.push_back(i);
+                chunkSize = 0;
+            }
+            chunkSize += bodies[i].size;
+        }
+    }
+
+    // the number of function bodies, which belong to the last functions of
+    // the module since the imported ones come first
+    size_t Bodies() const
+    {
+        return bodies.size();
+    }
+    size_t Chunks() const
+    {
+        return chunkStarts.size();
+    }
+    // the bodies in a chunk, counted from the first body
+    size_t ChunkBegin(size_t chunk) const
+    {
+        return chunkStarts[chunk];
+    }
+    size_t ChunkEnd(size_t chunk) const
+    {
+        return chunk + 1 < chunkStarts.size() ? chunkStarts[chunk + 1] : bodies.size();
+    }
+    wasm::Module *ParseSkeleton() const
+    {
+        return ParseWasm(Assemble(0, 0, false));
+    }
+    std::unique_ptr<wasm::Module> ParseChunk(size_t chunk) const
+    {
+        return std::unique_ptr<wasm::Module>(ParseWasm(Assemble(ChunkBegin(chunk), ChunkEnd(chunk), true)));
+    }
+    // whether two bodies, counted from the first body, are the same bytes,
+    // locals included
+    bool SameBody(size_t left, size_t right) const
+    {
+        const Body &leftBody = bodies[left];
+        const Body &rightBody = bodies[right];
+        return leftBody.size == rightBody.size && std::memcmp(binary.data() + leftBody.begin, binary.data() + rightBody.begin, leftBody.size) == 0;
+    }
+
+private:
+    static constexpr uint8_t customSection = 0;
+    static constexpr uint8_t codeSection = 10;
+    static constexpr uint8_t dataSection = 11;
+
+    struct Section
+    {
+        uint8_t id = 0;
+        // the contents, after the id and size
+        size_t begin = 0;
+        size_t end = 0;
+        std::string_view name;
+    };
+    struct Body
+    {
+        // the entry after its size, and how much of it declares the locals
+        size_t begin = 0;
+        size_t size = 0;
+        size_t localsSize = 0;
+    };
+
+    void ReadBodies(const Section &section)
+    {
+        WasmBinaryCursor cursor(binary, section.begin, section.end);
+        uint64_t count = cursor.LEB();
+        for (uint64_t i = 0; i < count; i++)
+        {
+            Body body;
+            body.size = cursor.LEB();
+            body.begin = cursor.position;
+
+            WasmBinaryCursor locals(binary, body.begin, body.begin + body.size);
+            uint64_t groups = locals.LEB();
+            for (uint64_t group = 0; group < groups; group++)
+            {
+                locals.SkipLEB();
+                uint8_t type = locals.Byte();
+                // (ref null ht) and (ref ht) are followed by the heap type
+                if (type == 0x63 || type == 0x64)
+                    locals.SkipLEB();
+            }
+            body.localsSize = locals.position - body.begin;
+
+            cursor.Skip(body.size);
+            bodies.push_back(body);
+        }
+    }
+    // the data section with the contents of every segment left out, or
+    // nothing when an offset is not a simple constant expression
+    std::vector<char> EmptyDataSegments(const Section &section) const
+    {
+        std::vector<char> contents;
+        WasmBinaryCursor cursor(binary, section.begin, section.end);
+        uint64_t count = cursor.LEB();
+        WriteLEB(contents, count);
+        for (uint64_t i = 0; i < count; i++)
+        {
+            size_t headerBegin = cursor.position;
+            uint64_t flags = cursor.LEB();
+            if (flags == 2)
+                cursor.SkipLEB(); // memory index
+            if (flags != 1)
+            {
+                while (true)
+                {
+                    uint8_t opcode = cursor.Byte();
+                    if (opcode == 0x0b) // end
+                        break;
+                    else if (opcode == 0x41 || opcode == 0x42 || opcode == 0x23) // i32.const, i64.const, global.get
+                        cursor.SkipLEB();
+                    else if (opcode != 0x6a && opcode != 0x6b && opcode != 0x6c && opcode != 0x7c && opcode != 0x7d && opcode != 0x7e) // extended constant arithmetic
+                        return {};
+                }
+            }
+            contents.insert(contents.end(), binary.begin() + headerBegin, binary.begin() + cursor.position);
+            WriteLEB(contents, 0);
+            cursor.Skip(cursor.LEB());
+        }
+        return contents;
+    }
+    // the binary with the bodies in [begin, end) and the placeholder for the
+    // others. the chunks leave out the data and every custom section except
+    // the names, which name the functions as in the skeleton
+    std::vector<char> Assemble(size_t begin, size_t end, bool chunk) const
+    {
+        std::vector<char> output(binary.begin(), binary.begin() + 8);
+        auto writeSection = [&](uint8_t id, const char *contents, size_t size)
+        {
+            output.push_back(char(id));
+            WriteLEB(output, size);
+            output.insert(output.end(), contents, contents + size);
+        };
+
+        for (const Section &section : sections)
+        {
+            if (chunk && section.id == customSection && section.name != "name")
+                continue;
+
+            if (section.id == codeSection)
+            {
+                std::vector<char> contents;
+                WriteLEB(contents, bodies.size());
+                for (size_t i = 0; i < bodies.size(); i++)
+                {
+                    const Body &body = bodies[i];
+                    const char *bytes = binary.data() + body.begin;
+                    if (i >= begin && i < end)
+                    {
+                        WriteLEB(contents, body.size);
+                        contents.insert(contents.end(), bytes, bytes + body.size);
+                    }
+                    else
+                    {
+                        // the locals followed by unreachable and end
+                        WriteLEB(contents, body.localsSize + 2);
+                        contents.insert(contents.end(), bytes, bytes + body.localsSize);
+                        contents.push_back(0x00);
+                        contents.push_back(0x0b);
+                    }
+                }
+                writeSection(section.id, contents.data(), contents.size());
+            }
+            else if (chunk && section.id == dataSection && !emptiedData.empty())
+                writeSection(section.id, emptiedData.data(), emptiedData.size());
+            else
+                writeSection(section.id, binary.data() + section.begin, section.end - section.begin);
+        }
+
+        return output;
+    }
+
+    std::vector<char> binary;
+    std::vector<Section> sections;
+    std::vector<Body> bodies;
+    std::vector<char> emptiedData;
+    std::vector<size_t> chunkStarts;
+};
+std::string GetStringFromWasmType(wasm::Type &type)
+{
+    switch (type.getBasic())
+    {
+    case wasm::Type::BasicType::i32:
+        return "int32_t";
+    case wasm::Type::BasicType::f32:
+        return "float";
+    case wasm::Type::BasicType::f64:
+        return "double";
+    case wasm::Type::BasicType::i64:
+        return "int64_t";
+    case wasm::Type::BasicType::v128:
+        return "v128";
+    case wasm::Type::BasicType::none:
+        return "void";
+    default:
+        Report("cannot convert type ", std::to_string(type.getBasic()), " to string");
+
+        return std::string("#") + std::to_string(type.getBasic());
+    }
+}
+void WriteFunctionSignature(CodeWriter &output, wasm::Function *function)
+{
+    wasm::Signature signature = function->getSig();
+    output << GetStringFromWasmType(signature.results) << " func" << function->name.str << "(";
+
+    size_t index = 0;
+    for (auto i = signature.params.begin(); i != signature.params.end(); i++)
+    {
+        wasm::Type parameterType = signature.params[index];
+        output << GetStringFromWasmType(parameterType) << ' ';
+        output.Local(index);
+        if (i != signature.params.end() - 1)
+            output << ", ";
+        index++;
+    }
+    output << ")";
+}
+// the emscripten style name of a signature: the result followed by the
+// parameters, one letter per type
+std::string GetSignatureName(const wasm::Signature &signature)
+{
+    auto letter = [](wasm::Type type)
+    {
+        switch (type.getBasic())
+        {
+        case wasm::Type::BasicType::none:
+            return 'v';
+        case wasm::Type::BasicType::i32:
+            return 'i';
+        case wasm::Type::BasicType::i64:
+            return 'j';
+        case wasm::Type::BasicType::f32:
+            return 'f';
+        case wasm::Type::BasicType::f64:
+            return 'd';
+        default:
+            return 'V';
+        }
+    };
+
+    std::string name(1, letter(signature.results));
+    for (wasm::Type type : signature.params)
+        name += letter(type);
+    return name;
+}
+// a run of consecutive br_table entries jumping to the same label
+struct SwitchRange
+{
+    uint32_t first;
+    uint32_t last;
+    wasm::Name target;
+};
+// an expression being written. `step` is where writing resumes once the child
+// pushed above it is finished, `index` the position in a list of children and
+// `savedDepth` the expression depth to restore after a nested statement
+struct EmitFrame
+{
+    EmitFrame(wasm::Expression *expression) : expression(expression)
+    {
+    }
+
+    wasm::Expression *expression;
+    uint32_t step = 0;
+    size_t index = 0;
+    size_t savedDepth = 0;
+    // the merged entries of a br_table, between writing its condition and
+    // its jump
+    std::vector<SwitchRange> switchRanges;
+};
+// suspends the expression on top of the stack until `child` is written, then
+// resumes it at `step`
+void PushEmitFrame(std::vector<EmitFrame> &stack, uint32_t step, wasm::Expression *child)
+{
+    stack.back().step = step;
+    stack.push_back({child});
+}
+void PopEmitFrame(std::vector<EmitFrame> &stack)
+{
+    stack.pop_back();
+}
+// opens the condition of an if or br_if. a condition the profile shows to
+// be almost always true or false is wrapped in __builtin_expect
+void BeginWasm2cCondition(EmitterContext &context, CodeWriter &output, EmitFrame &frame)
+{
+    auto found = context.branchIndices.find(frame.expression);
+    frame.index = found != context.branchIndices.end() ? found->second : SIZE_MAX;
+    output << "if (";
+    if (GetBranchExpectation(context.profile, frame.index) >= 0)
+        output << "__builtin_expect(!!(";
+}
+void EndWasm2cCondition(EmitterContext &context, CodeWriter &output, const EmitFrame &frame)
+{
+    int expectation = GetBranchExpectation(context.profile, frame.index);
+    if (expectation >= 0)
+        output << "), " << expectation << ")";
+    output << ")\n";
+}
+// writes a constant as C that reads back as exactly the same value: the
+// shortest digits that round trip for floats, builtins for infinities and
+// nans, and the minimum integers as an expression since their magnitude
+// does not fit the type
+void WriteWasm2cLiteral(CodeWriter &output, const wasm::Literal &literal)
+{
+    if (literal.type == wasm::Type::i32)
+    {
+        int32_t value = literal.geti32();
+        if (value == INT32_MIN)
+            output << "(-2147483647 - 1)";
+        else
+            output << value;
+    }
+    else if (literal.type == wasm::Type::i64)
+    {
+        int64_t value = literal.geti64();
+        if (value == INT64_MIN)
+            output << "(-9223372036854775807ll - 1)";
+        else
+            output << value;
+    }
+    else if (literal.type == wasm::Type::f32 || literal.type == wasm::Type::f64)
+    {
+        bool single = literal.type == wasm::Type::f32;
+        double value = single ? literal.getf32() : literal.getf64();
+        const char *suffix = single ? "f" : "";
+        if (std::signbit(value))
+            output << '-';
+
+        char text[64];
+        if (std::isnan(value))
+        {
+            uint64_t payload = uint64_t(literal.getBits()) & (single ? 0x7fffffull : 0xfffffffffffffull);
+            std::snprintf(text, sizeof(text), "__builtin_nan%s(\"0x%llx\")", suffix, (unsigned long long)payload);
+            output << text;
+        }
+        else if (std::isinf(value))
+            output << "__builtin_inf" << suffix << "()";
+        else
+        {
+            char *end = single ? std::to_chars(text, text + sizeof(text), std::fabs(literal.getf32())).ptr : std::to_chars(text, text + sizeof(text), std::fabs(value)).ptr;
+            output << std::string_view(text, end - text);
+            // keep it a floating constant
+            if (std::find_if(text, end, [](char character)
+                             { return character == '.' || character == 'e'; }) == end)
+                output << ".0";
+            output << suffix;
+        }
+    }
+    else if (literal.type == wasm::Type::v128)
+    {
+        // the 16 bytes as two little endian halves
+        std::array<uint8_t, 16> bytes = literal.getv128();
+        uint64_t halves[2];
+        std::memcpy(halves, bytes.data(), sizeof(halves));
+        char text[64];
+        std::snprintf(text, sizeof(text), "__ConstVec128(0x%016llxull, 0x%016llxull)", (unsigned long long)halves[0], (unsigned long long)halves[1]);
+        output << text;
+    }
+    else
+    {
+        Report("unable to convert wasm const id ", std::to_string(literal.type.getID()), " to string");
+        output << "const" << literal.type.getID();
+    }
+}
+// writes a pointer to the `bytes` bytes at pointer + offset, the pointer
+// going between the two halves. runtime memory modes compute the address
+// through WASM_ADDRESS, which the generated runtime defines for the chosen
+// mode
+void BeginWasm2cMemoryAddress(EmitterContext &context, CodeWriter &output)
+{
+    output << "u8 + ";
+    context.expressionDepth++;
+    if (context.memoryMode == MemoryMode::None)
+        output << '(';
+    else
+        output << "WASM_ADDRESS(";
+}
+void EndWasm2cMemoryAddress(EmitterContext &context, CodeWriter &output, uint64_t offset, uint8_t bytes)
+{
+    if (context.memoryMode == MemoryMode::None)
+        output << " + " << offset << ')';
+    else
+        output << ", " << offset << ", " << bytes << ')';
+    context.expressionDepth--;
+}
+// the suffix of the wasm_load_ and wasm_store_ helpers accessing `bytes`
+// bytes as `type`: f32 and f64 for floats, otherwise the integer held in
+// memory, whose signedness decides how a narrow load is extended
+const char *GetMemoryAccessName(wasm::Type type, uint8_t bytes, bool isSigned)
+{
+    if (type == wasm::Type::f32)
+        return "f32";
+    if (type == wasm::Type::f64)
+        return "f64";
+
+    switch (bytes)
+    {
+    case 1:
+        return isSigned ? "i8" : "u8";
+    case 2:
+        return isSigned ? "i16" : "u16";
+    case 4:
+        return isSigned ? "i32" : "u32";
+    default:
+        return isSigned ? "i64" : "u64";
+    }
+}
+// writes the address passed to a wasm_load_ or wasm_store_ helper. an access
+// whose alignment hint is at least its size goes through WASM_ALIGNED, which
+// only assumes the alignment when WASM2C_TRUST_ALIGNMENT is defined since
+// wasm allows wrong hints
+void BeginWasm2cMemoryAccess(EmitterContext &context, CodeWriter &output, uint8_t bytes, uint64_t align)
+{
+    if (bytes > 1 && align >= bytes)
+        output << "WASM_ALIGNED(";
+    BeginWasm2cMemoryAddress(context, output);
+}
+void EndWasm2cMemoryAccess(EmitterContext &context, CodeWriter &output, uint64_t offset, uint8_t bytes, uint64_t align)
+{
+    EndWasm2cMemoryAddress(context, output, offset, bytes);
+    if (bytes > 1 && align >= bytes)
+        output << ", " << bytes << ')';
+}
+// the helpers of wasm2c_simd.h are named after the binaryen operation they
+// implement, like the scalar unary helpers
+#define SIMD_OPERATION_NAME(x) \
+    case wasm::x:              \
+        return "__" #x;
+
+// nullptr for the scalar operations, which are written as C operators
+const char *GetSimdOperationName(wasm::BinaryOp operation)
+{
+    switch (operation)
+    {
+        SIMD_OPERATION_NAME(EqVecI8x16)
+        SIMD_OPERATION_NAME(NeVecI8x16)
+        SIMD_OPERATION_NAME(LtSVecI8x16)
+        SIMD_OPERATION_NAME(LtUVecI8x16)
+        SIMD_OPERATION_NAME(GtSVecI8x16)
+        SIMD_OPERATION_NAME(GtUVecI8x16)
+        SIMD_OPERATION_NAME(LeSVecI8x16)
+        SIMD_OPERATION_NAME(LeUVecI8x16)
+        SIMD_OPERATION_NAME(GeSVecI8x16)
+        SIMD_OPERATION_NAME(GeUVecI8x16)
+        SIMD_OPERATION_NAME(EqVecI16x8)
+        SIMD_OPERATION_NAME(NeVecI16x8)
+        SIMD_OPERATION_NAME(LtSVecI16x8)
+        SIMD_OPERATION_NAME(LtUVecI16x8)
+        SIMD_OPERATION_NAME(GtSVecI16x8)
+        SIMD_OPERATION_NAME(GtUVecI16x8)
+        SIMD_OPERATION_NAME(LeSVecI16x8)
+        SIMD_OPERATION_NAME(LeUVecI16x8)
+        SIMD_OPERATION_NAME(GeSVecI16x8)
+        SIMD_OPERATION_NAME(GeUVecI16x8)
+        SIMD_OPERATION_NAME(EqVecI32x4)
+        SIMD_OPERATION_NAME(NeVecI32x4)
+        SIMD_OPERATION_NAME(LtSVecI32x4)
+        SIMD_OPERATION_NAME(LtUVecI32x4)
+        SIMD_OPERATION_NAME(GtSVecI32x4)
+        SIMD_OPERATION_NAME(GtUVecI32x4)
+        SIMD_OPERATION_NAME(LeSVecI32x4)
+        SIMD_OPERATION_NAME(LeUVecI32x4)
+        SIMD_OPERATION_NAME(GeSVecI32x4)
+        SIMD_OPERATION_NAME(GeUVecI32x4)
+        SIMD_OPERATION_NAME(EqVecI64x2)
+        SIMD_OPERATION_NAME(NeVecI64x2)
+        SIMD_OPERATION_NAME(LtSVecI64x2)
+        SIMD_OPERATION_NAME(GtSVecI64x2)
+        SIMD_OPERATION_NAME(LeSVecI64x2)
+        SIMD_OPERATION_NAME(GeSVecI64x2)
+        SIMD_OPERATION_NAME(EqVecF32x4)
+        SIMD_OPERATION_NAME(NeVecF32x4)
+        SIMD_OPERATION_NAME(LtVecF32x4)
+        SIMD_OPERATION_NAME(GtVecF32x4)
+        SIMD_OPERATION_NAME(LeVecF32x4)
+        SIMD_OPERATION_NAME(GeVecF32x4)
+        SIMD_OPERATION_NAME(EqVecF64x2)
+        SIMD_OPERATION_NAME(NeVecF64x2)
+        SIMD_OPERATION_NAME(LtVecF64x2)
+        SIMD_OPERATION_NAME(GtVecF64x2)
+        SIMD_OPERATION_NAME(LeVecF64x2)
+        SIMD_OPERATION_NAME(GeVecF64x2)
+        SIMD_OPERATION_NAME(AndVec128)
+        SIMD_OPERATION_NAME(OrVec128)
+        SIMD_OPERATION_NAME(XorVec128)
+        SIMD_OPERATION_NAME(AndNotVec128)
+        SIMD_OPERATION_NAME(AddVecI8x16)
+        SIMD_OPERATION_NAME(AddSatSVecI8x16)
+        SIMD_OPERATION_NAME(AddSatUVecI8x16)
+        SIMD_OPERATION_NAME(SubVecI8x16)
+        SIMD_OPERATION_NAME(SubSatSVecI8x16)
+        SIMD_OPERATION_NAME(SubSatUVecI8x16)
+        SIMD_OPERATION_NAME(MinSVecI8x16)
+        SIMD_OPERATION_NAME(MinUVecI8x16)
+        SIMD_OPERATION_NAME(MaxSVecI8x16)
+        SIMD_OPERATION_NAME(MaxUVecI8x16)
+        SIMD_OPERATION_NAME(AvgrUVecI8x16)
+        SIMD_OPERATION_NAME(AddVecI16x8)
+        SIMD_OPERATION_NAME(AddSatSVecI16x8)
+        SIMD_OPERATION_NAME(AddSatUVecI16x8)
+        SIMD_OPERATION_NAME(SubVecI16x8)
+        SIMD_OPERATION_NAME(SubSatSVecI16x8)
+        SIMD_OPERATION_NAME(SubSatUVecI16x8)
+        SIMD_OPERATION_NAME(MulVecI16x8)
+        SIMD_OPERATION_NAME(MinSVecI16x8)
+        SIMD_OPERATION_NAME(MinUVecI16x8)
+        SIMD_OPERATION_NAME(MaxSVecI16x8)
+        SIMD_OPERATION_NAME(MaxUVecI16x8)
+        SIMD_OPERATION_NAME(AvgrUVecI16x8)
+        SIMD_OPERATION_NAME(Q15MulrSatSVecI16x8)
+        SIMD_OPERATION_NAME(ExtMulLowSVecI16x8)
+        SIMD_OPERATION_NAME(ExtMulHighSVecI16x8)
+        SIMD_OPERATION_NAME(ExtMulLowUVecI16x8)
+        SIMD_OPERATION_NAME(ExtMulHighUVecI16x8)
+        SIMD_OPERATION_NAME(AddVecI32x4)
+        SIMD_OPERATION_NAME(SubVecI32x4)
+        SIMD_OPERATION_NAME(MulVecI32x4)
+        SIMD_OPERATION_NAME(MinSVecI32x4)
+        SIMD_OPERATION_NAME(MinUVecI32x4)
+        SIMD_OPERATION_NAME(MaxSVecI32x4)
+        SIMD_OPERATION_NAME(MaxUVecI32x4)
+        SIMD_OPERATION_NAME(DotSVecI16x8ToVecI32x4)
+        SIMD_OPERATION_NAME(ExtMulLowSVecI32x4)
+        SIMD_OPERATION_NAME(ExtMulHighSVecI32x4)
+        SIMD_OPERATION_NAME(ExtMulLowUVecI32x4)
+        SIMD_OPERATION_NAME(ExtMulHighUVecI32x4)
+        SIMD_OPERATION_NAME(AddVecI64x2)
+        SIMD_OPERATION_NAME(SubVecI64x2)
+        SIMD_OPERATION_NAME(MulVecI64x2)
+        SIMD_OPERATION_NAME(ExtMulLowSVecI64x2)
+        SIMD_OPERATION_NAME(ExtMulHighSVecI64x2)
+        SIMD_OPERATION_NAME(ExtMulLowUVecI64x2)
+        SIMD_OPERATION_NAME(ExtMulHighUVecI64x2)
+        SIMD_OPERATION_NAME(AddVecF32x4)
+        SIMD_OPERATION_NAME(SubVecF32x4)
+        SIMD_OPERATION_NAME(MulVecF32x4)
+        SIMD_OPERATION_NAME(DivVecF32x4)
+        SIMD_OPERATION_NAME(MinVecF32x4)
+        SIMD_OPERATION_NAME(MaxVecF32x4)
+        SIMD_OPERATION_NAME(PMinVecF32x4)
+        SIMD_OPERATION_NAME(PMaxVecF32x4)
+        SIMD_OPERATION_NAME(AddVecF64x2)
+        SIMD_OPERATION_NAME(SubVecF64x2)
+        SIMD_OPERATION_NAME(MulVecF64x2)
+        SIMD_OPERATION_NAME(DivVecF64x2)
+        SIMD_OPERATION_NAME(MinVecF64x2)
+        SIMD_OPERATION_NAME(MaxVecF64x2)
+        SIMD_OPERATION_NAME(PMinVecF64x2)
+        SIMD_OPERATION_NAME(PMaxVecF64x2)
+        SIMD_OPERATION_NAME(NarrowSVecI16x8ToVecI8x16)
+        SIMD_OPERATION_NAME(NarrowUVecI16x8ToVecI8x16)
+        SIMD_OPERATION_NAME(NarrowSVecI32x4ToVecI16x8)
+        SIMD_OPERATION_NAME(NarrowUVecI32x4ToVecI16x8)
+        SIMD_OPERATION_NAME(SwizzleVecI8x16)
+    default:
+        return nullptr;
+    }
+}
+const char *GetSimdOperationName(wasm::SIMDExtractOp operation)
+{
+    switch (operation)
+    {
+        SIMD_OPERATION_NAME(ExtractLaneSVecI8x16)
+        SIMD_OPERATION_NAME(ExtractLaneUVecI8x16)
+        SIMD_OPERATION_NAME(ExtractLaneSVecI16x8)
+        SIMD_OPERATION_NAME(ExtractLaneUVecI16x8)
+        SIMD_OPERATION_NAME(ExtractLaneVecI32x4)
+        SIMD_OPERATION_NAME(ExtractLaneVecI64x2)
+        SIMD_OPERATION_NAME(ExtractLaneVecF32x4)
+        SIMD_OPERATION_NAME(ExtractLaneVecF64x2)
+    }
+    return nullptr;
+}
+const char *GetSimdOperationName(wasm::SIMDReplaceOp operation)
+{
+    switch (operation)
+    {
+        SIMD_OPERATION_NAME(ReplaceLaneVecI8x16)
+        SIMD_OPERATION_NAME(ReplaceLaneVecI16x8)
+        SIMD_OPERATION_NAME(ReplaceLaneVecI32x4)
+        SIMD_OPERATION_NAME(ReplaceLaneVecI64x2)
+        SIMD_OPERATION_NAME(ReplaceLaneVecF32x4)
+        SIMD_OPERATION_NAME(ReplaceLaneVecF64x2)
+    }
+    return nullptr;
+}
+const char *GetSimdOperationName(wasm::SIMDShiftOp operation)
+{
+    switch (operation)
+    {
+        SIMD_OPERATION_NAME(ShlVecI8x16)
+        SIMD_OPERATION_NAME(ShrSVecI8x16)
+        SIMD_OPERATION_NAME(ShrUVecI8x16)
+        SIMD_OPERATION_NAME(ShlVecI16x8)
+        SIMD_OPERATION_NAME(ShrSVecI16x8)
+        SIMD_OPERATION_NAME(ShrUVecI16x8)
+        SIMD_OPERATION_NAME(ShlVecI32x4)
+        SIMD_OPERATION_NAME(ShrSVecI32x4)
+        SIMD_OPERATION_NAME(ShrUVecI32x4)
+        SIMD_OPERATION_NAME(ShlVecI64x2)
+        SIMD_OPERATION_NAME(ShrSVecI64x2)
+        SIMD_OPERATION_NAME(ShrUVecI64x2)
+    }
+    return nullptr;
+}
+const char *GetSimdOperationName(wasm::SIMDLoadOp operation)
+{
+    switch (operation)
+    {
+        SIMD_OPERATION_NAME(Load8SplatVec128)
+        SIMD_OPERATION_NAME(Load16SplatVec128)
+        SIMD_OPERATION_NAME(Load32SplatVec128)
+        SIMD_OPERATION_NAME(Load64SplatVec128)
+        SIMD_OPERATION_NAME(Load8x8SVec128)
+        SIMD_OPERATION_NAME(Load8x8UVec128)
+        SIMD_OPERATION_NAME(Load16x4SVec128)
+        SIMD_OPERATION_NAME(Load16x4UVec128)
+        SIMD_OPERATION_NAME(Load32x2SVec128)
+        SIMD_OPERATION_NAME(Load32x2UVec128)
+        SIMD_OPERATION_NAME(Load32ZeroVec128)
+        SIMD_OPERATION_NAME(Load64ZeroVec128)
+    }
+    return nullptr;
+}
+const char *GetSimdOperationName(wasm::SIMDLoadStoreLaneOp operation)
+{
+    switch (operation)
+    {
+        SIMD_OPERATION_NAME(Load8LaneVec128)
+        SIMD_OPERATION_NAME(Load16LaneVec128)
+        SIMD_OPERATION_NAME(Load32LaneVec128)
+        SIMD_OPERATION_NAME(Load64LaneVec128)
+        SIMD_OPERATION_NAME(Store8LaneVec128)
+        SIMD_OPERATION_NAME(Store16LaneVec128)
+        SIMD_OPERATION_NAME(Store32LaneVec128)
+        SIMD_OPERATION_NAME(Store64LaneVec128)
+    }
+    return nullptr;
+}
+// nullptr for the relaxed simd operations, which are not enabled
+const char *GetSimdOperationName(wasm::SIMDTernaryOp operation)
+{
+    return operation == wasm::Bitselect ? "__BitselectVec128" : nullptr;
+}
+
+#undef SIMD_OPERATION_NAME
+// writes a call to a runtime helper: the operands in order, followed by the
+// constant immediates of the instruction. PushWasm2cHelperOperand pushes the
+// next operand and returns false once they are all written
+void BeginWasm2cHelperCall(EmitterContext &context, CodeWriter &output, const char *name)
+{
+    output << name << '(';
+    context.expressionDepth++;
+}
+bool PushWasm2cHelperOperand(CodeWriter &output, std::vector<EmitFrame> &stack, std::initializer_list<wasm::Expression *> operands)
+{
+    uint32_t written = stack.back().step;
+    if (written == operands.size())
+        return false;
+    if (written != 0)
+        output << ", ";
+    PushEmitFrame(stack, written + 1, operands.begin()[written]);
+    return true;
+}
+void EndWasm2cHelperCall(EmitterContext &context, CodeWriter &output, std::string_view immediates = {})
+{
+    context.expressionDepth--;
+    if (!immediates.empty())
+        output << ", " << immediates;
+    output << ')';
+}
+// where a br_table entry jumps to: the start of a loop, or the end of a block
+void WriteWasm2cSwitchLabel(EmitterContext &context, CodeWriter &output, wasm::Name target)
+{
+    output << target.str;
+    if (context.loops.count(target.str) == 0)
+        output << "_end";
+}
+// the runs of a br_table's entries, leaving out the ones jumping to the
+// default
+std::vector<SwitchRange> GetWasm2cSwitchRanges(wasm::Switch *instruction)
+{
+    std::vector<SwitchRange> ranges;
+    for (uint32_t i = 0; i < instruction->targets.size(); i++)
+    {
+        wasm::Name target = instruction->targets[i];
+        if (target == instruction->default_)
+            continue;
+
+        if (!ranges.empty() && ranges.back().last + 1 == i && ranges.back().target == target)
+            ranges.back().last = i;
+        else
+            ranges.push_back({i, i, target});
+    }
+    return ranges;
+}
+// a br_table needing many cases even with the runs merged, like the
+// dispatch of an interpreter, jumps through a table of label addresses
+// instead of a switch
+bool IsWasm2cJumpTable(const std::vector<SwitchRange> &ranges)
+{
+    constexpr size_t minimumJumpTableRanges = 8;
+
+    return ranges.size() >= minimumJumpTableRanges;
+}
+// the cases of a br_table switch, the runs of entries sharing a target
+// merged into case ranges and listed together before their goto. entries
+// jumping to the default are left to it
+void WriteWasm2cSwitchCases(EmitterContext &context, CodeWriter &output, wasm::Switch *instruction, const std::vector<SwitchRange> &ranges)
+{
+    output.Indentation() << "{\n";
+    output.Indent();
+    std::vector<bool> written(ranges.size(), false);
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        if (written[i])
+            continue;
+
+        wasm::Name target = ranges[i].target;
+        for (size_t j = i; j < ranges.size(); j++)
+        {
+            if (written[j] || ranges[j].target != target)
+                continue;
+
+            output.Indentation() << "case " << ranges[j].first;
+            if (ranges[j].last != ranges[j].first)
+                output << " ... " << ranges[j].last;
+            output << ":\n";
+            written[j] = true;
+        }
+        output.Indent();
+        output.Indentation() << "goto ";
+        WriteWasm2cSwitchLabel(context, output, target);
+        output << ";\n";
+        output.Dedent();
+    }
+    output.Indentation() << "default:\n";
+    output.Indent();
+    output.Indentation() << "goto ";
+    WriteWasm2cSwitchLabel(context, output, instruction->default_);
+    output << ";\n";
+    output.Dedent();
+    output.Dedent();
+    output.Indentation() << "}\n";
+}
+// the jump of a br_table through a table of label addresses, a gcc and
+// clang extension, with the default in the slot past the entries that any
+// larger index is clamped to
+void WriteWasm2cJumpTable(EmitterContext &context, CodeWriter &output, wasm::Switch *instruction)
+{
+    size_t count = instruction->targets.size();
+
+    output.Indentation() << "static void *const labels[] = {";
+    for (size_t i = 0; i <= count; i++)
+    {
+        if (i != 0)
+            output << ", ";
+        output << "&&";
+        WriteWasm2cSwitchLabel(context, output, i < count ? instruction->targets[i] : instruction->default_);
+    }
+    output << "};\n";
+    output.Indentation() << "goto *labels[index < " << count << "u ? index : " << count << "u];\n";
+}
+// writes the expression on top of the stack until it needs a child written,
+// which is pushed above it, or until it is finished and popped. the text and
+// the order it is written in are those of a recursive descent over the tree
+void ResumeWasm2cExpression(EmitterContext &context, CodeWriter &output, std::vector<EmitFrame> &stack)
+{
+    EmitFrame &frame = stack.back();
+    wasm::Expression *expression = frame.expression;
+    wasm::Expression::Id id = expression->_id;
+    switch (id)
+    {
+    case wasm::Expression::CallId:
+    {
+        wasm::Call *functionCall = static_cast<wasm::Call *>(expression);
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation();
+            output << "func";
+            output << functionCall->target.str;
+            output << "(";
+            context.expressionDepth++;
+        }
+        else
+        {
+            if (frame.index != functionCall->operands.size() - 1)
+                output << ", ";
+            else if (functionCall->operands[frame.index]->_id == wasm::Expression::IfId)
+                output.Indentation();
+            frame.index++;
+        }
+        if (frame.index < functionCall->operands.size())
+            return PushEmitFrame(stack, 1, functionCall->operands[frame.index]);
+        output << ")";
+        context.expressionDepth--;
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::BlockId:
+    {
+        wasm::Block *block = static_cast<wasm::Block *>(expression);
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth != 0)
+                output.Indent();
+            else
+                output.Indentation();
+            if (block->name.str != nullptr)
+            {
+                output << block->name.str << ":\n";
+                output.Indentation();
+            }
+            output << "{\n";
+            output.Indent();
+            frame.savedDepth = context.expressionDepth;
+            context.expressionDepth = 0;
+        }
+        else
+            frame.index++;
+        if (frame.index < block->list.size())
+            return PushEmitFrame(stack, 1, block->list[frame.index]);
+        context.expressionDepth = frame.savedDepth;
+        // inside the braces, so the block stays one statement as the arm of
+        // an if
+        if (block->name.str != nullptr && context.switchTargets.count(block->name.str) != 0)
+            output.Indentation() << block->name.str << "_end:;\n";
+        output.Dedent();
+        output.Indentation() << "}";
+        if (context.expressionDepth != 0)
+        {
+            output.Dedent();
+            output << "\n";
+            output.Indentation();
+        }
+        else
+            output << "\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::LocalGetId:
+    {
+        wasm::LocalGet *localGetExpression = static_cast<wasm::LocalGet *>(expression);
+
+        if (context.expressionDepth != 0)
+            output.Local(localGetExpression->index);
+        else
+        {
+            output.Indentation() << "return ";
+            output.Local(localGetExpression->index) << ";\n";
+        }
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::LoadId:
+    {
+        wasm::Load *loadInstruction = static_cast<wasm::Load *>(expression);
+
+        switch (frame.step)
+        {
+        case 0:
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+
+            if (loadInstruction->bytes == 1 || loadInstruction->bytes == 2 || loadInstruction->bytes == 4 || loadInstruction->bytes == 8)
+            {
+                // a narrow load is extended by converting the memory integer
+                wasm::Type type = loadInstruction->type;
+                bool extended = loadInstruction->bytes < type.getByteSize();
+                if (extended)
+                    output << '(' << GetStringFromWasmType(type) << ')';
+                output << "wasm_load_" << GetMemoryAccessName(type, loadInstruction->bytes, loadInstruction->signed_ || !extended) << '(';
+                BeginWasm2cMemoryAccess(context, output, loadInstruction->bytes, loadInstruction->align.addr);
+                return PushEmitFrame(stack, 1, loadInstruction->ptr);
+            }
+            else if (loadInstruction->bytes == 16)
+            {
+                output << "__LoadVec128(";
+                BeginWasm2cMemoryAddress(context, output);
+                return PushEmitFrame(stack, 2, loadInstruction->ptr);
+            }
+            Report("load with ", std::to_string(loadInstruction->bytes), " not supported");
+            output << "unimplementedload" << loadInstruction->bytes;
+            break;
+        case 1:
+            EndWasm2cMemoryAccess(context, output, loadInstruction->offset.addr, loadInstruction->bytes, loadInstruction->align.addr);
+            output << ')';
+            break;
+        case 2:
+            EndWasm2cMemoryAddress(context, output, loadInstruction->offset.addr, loadInstruction->bytes);
+            output << ")";
+            break;
+        }
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::LocalSetId:
+    {
+        wasm::LocalSet *setInstruction = static_cast<wasm::LocalSet *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation();
+            output.Local(setInstruction->index) << " = ";
+            if (setInstruction->value->_id == wasm::Expression::IfId)
+            {
+                output.Indent();
+                output << "(";
+            }
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, setInstruction->value);
+        }
+        context.expressionDepth--;
+
+        if (setInstruction->value->_id == wasm::Expression::IfId)
+        {
+            output.Dedent();
+            output.Indentation() << ")";
+        }
+        if (context.expressionDepth == 0)
+        {
+            if (setInstruction->value->_id != wasm::Expression::BlockId)
+                output << ';';
+            output << '\n';
+        }
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::BreakId:
+    {
+        wasm::Break *breakInstruction = static_cast<wasm::Break *>(expression);
+
+        switch (frame.step)
+        {
+        case 0:
+            if (breakInstruction->condition != nullptr)
+            {
+                if (context.expressionDepth == 0)
+                    output.Indentation();
+
+                BeginWasm2cCondition(context, output, frame);
+                context.expressionDepth++;
+                return PushEmitFrame(stack, 1, breakInstruction->condition);
+            }
+            [[fallthrough]];
+        case 1:
+            if (breakInstruction->condition != nullptr)
+            {
+                context.expressionDepth--;
+                EndWasm2cCondition(context, output, frame);
+                output.Indent();
+            }
+            output.Indentation() << "break";
+            if (breakInstruction->condition != nullptr)
+                output.Dedent();
+            if (breakInstruction->value != nullptr)
+            {
+                output << " (";
+                context.expressionDepth++;
+                return PushEmitFrame(stack, 2, breakInstruction->value);
+            }
+            break;
+        case 2:
+            context.expressionDepth--;
+            output << ")";
+            break;
+        }
+        output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::UnaryId:
+    {
+        wasm::Unary *unaryInstruction = static_cast<wasm::Unary *>(expression);
+        if (frame.step == 0)
+        {
+#define APPEND_TO_OUTPUT(x)    \
+    case wasm::x:              \
+        output << "__" #x "("; \
+        break;
+
+            switch (unaryInstruction->op)
+            {
+                APPEND_TO_OUTPUT(ClzInt32)
+                APPEND_TO_OUTPUT(ClzInt64)
+                APPEND_TO_OUTPUT(CtzInt32)
+                APPEND_TO_OUTPUT(CtzInt64)
+                APPEND_TO_OUTPUT(PopcntInt32)
+                APPEND_TO_OUTPUT(PopcntInt64)
+                APPEND_TO_OUTPUT(NegFloat32)
+                APPEND_TO_OUTPUT(NegFloat64)
+                APPEND_TO_OUTPUT(AbsFloat32)
+                APPEND_TO_OUTPUT(AbsFloat64)
+                APPEND_TO_OUTPUT(CeilFloat32)
+                APPEND_TO_OUTPUT(CeilFloat64)
+                APPEND_TO_OUTPUT(FloorFloat32)
+                APPEND_TO_OUTPUT(FloorFloat64)
+                APPEND_TO_OUTPUT(TruncFloat32)
+                APPEND_TO_OUTPUT(TruncFloat64)
+                APPEND_TO_OUTPUT(NearestFloat32)
+                APPEND_TO_OUTPUT(NearestFloat64)
+                APPEND_TO_OUTPUT(SqrtFloat32)
+                APPEND_TO_OUTPUT(SqrtFloat64)
+                APPEND_TO_OUTPUT(EqZInt32)
+                APPEND_TO_OUTPUT(EqZInt64)
+                APPEND_TO_OUTPUT(ExtendSInt32)
+                APPEND_TO_OUTPUT(ExtendUInt32)
+                APPEND_TO_OUTPUT(WrapInt64)
+                APPEND_TO_OUTPUT(TruncSFloat32ToInt32)
+                APPEND_TO_OUTPUT(TruncSFloat32ToInt64)
+                APPEND_TO_OUTPUT(TruncUFloat32ToInt32)
+                APPEND_TO_OUTPUT(TruncUFloat32ToInt64)
+                APPEND_TO_OUTPUT(TruncSFloat64ToInt32)
+                APPEND_TO_OUTPUT(TruncSFloat64ToInt64)
+                APPEND_TO_OUTPUT(TruncUFloat64ToInt32)
+                APPEND_TO_OUTPUT(TruncUFloat64ToInt64)
+                APPEND_TO_OUTPUT(ReinterpretFloat32)
+                APPEND_TO_OUTPUT(ReinterpretFloat64)
+                APPEND_TO_OUTPUT(ConvertSInt32ToFloat32)
+                APPEND_TO_OUTPUT(ConvertSInt32ToFloat64)
+                APPEND_TO_OUTPUT(ConvertUInt32ToFloat32)
+                APPEND_TO_OUTPUT(ConvertUInt32ToFloat64)
+                APPEND_TO_OUTPUT(ConvertSInt64ToFloat32)
+                APPEND_TO_OUTPUT(ConvertSInt64ToFloat64)
+                APPEND_TO_OUTPUT(ConvertUInt64ToFloat32)
+                APPEND_TO_OUTPUT(ConvertUInt64ToFloat64)
+                APPEND_TO_OUTPUT(PromoteFloat32)
+                APPEND_TO_OUTPUT(DemoteFloat64)
+                APPEND_TO_OUTPUT(ReinterpretInt32)
+                APPEND_TO_OUTPUT(ReinterpretInt64)
+                APPEND_TO_OUTPUT(ExtendS8Int32)
+                APPEND_TO_OUTPUT(ExtendS16Int32)
+                APPEND_TO_OUTPUT(ExtendS8Int64)
+                APPEND_TO_OUTPUT(ExtendS16Int64)
+                APPEND_TO_OUTPUT(ExtendS32Int64)
+                APPEND_TO_OUTPUT(TruncSatSFloat32ToInt32)
+                APPEND_TO_OUTPUT(TruncSatUFloat32ToInt32)
+                APPEND_TO_OUTPUT(TruncSatSFloat64ToInt32)
+                APPEND_TO_OUTPUT(TruncSatUFloat64ToInt32)
+                APPEND_TO_OUTPUT(TruncSatSFloat32ToInt64)
+                APPEND_TO_OUTPUT(TruncSatUFloat32ToInt64)
+                APPEND_TO_OUTPUT(TruncSatSFloat64ToInt64)
+                APPEND_TO_OUTPUT(TruncSatUFloat64ToInt64)
+                APPEND_TO_OUTPUT(SplatVecI8x16)
+                APPEND_TO_OUTPUT(SplatVecI16x8)
+                APPEND_TO_OUTPUT(SplatVecI32x4)
+                APPEND_TO_OUTPUT(SplatVecI64x2)
+                APPEND_TO_OUTPUT(SplatVecF32x4)
+                APPEND_TO_OUTPUT(SplatVecF64x2)
+                APPEND_TO_OUTPUT(NotVec128)
+                APPEND_TO_OUTPUT(AnyTrueVec128)
+                APPEND_TO_OUTPUT(AbsVecI8x16)
+                APPEND_TO_OUTPUT(NegVecI8x16)
+                APPEND_TO_OUTPUT(AllTrueVecI8x16)
+                APPEND_TO_OUTPUT(BitmaskVecI8x16)
+                APPEND_TO_OUTPUT(PopcntVecI8x16)
+                APPEND_TO_OUTPUT(AbsVecI16x8)
+                APPEND_TO_OUTPUT(NegVecI16x8)
+                APPEND_TO_OUTPUT(AllTrueVecI16x8)
+                APPEND_TO_OUTPUT(BitmaskVecI16x8)
+                APPEND_TO_OUTPUT(AbsVecI32x4)
+                APPEND_TO_OUTPUT(NegVecI32x4)
+                APPEND_TO_OUTPUT(AllTrueVecI32x4)
+                APPEND_TO_OUTPUT(BitmaskVecI32x4)
+                APPEND_TO_OUTPUT(AbsVecI64x2)
+                APPEND_TO_OUTPUT(NegVecI64x2)
+                APPEND_TO_OUTPUT(AllTrueVecI64x2)
+                APPEND_TO_OUTPUT(BitmaskVecI64x2)
+                APPEND_TO_OUTPUT(AbsVecF32x4)
+                APPEND_TO_OUTPUT(NegVecF32x4)
+                APPEND_TO_OUTPUT(SqrtVecF32x4)
+                APPEND_TO_OUTPUT(CeilVecF32x4)
+                APPEND_TO_OUTPUT(FloorVecF32x4)
+                APPEND_TO_OUTPUT(TruncVecF32x4)
+                APPEND_TO_OUTPUT(NearestVecF32x4)
+                APPEND_TO_OUTPUT(AbsVecF64x2)
+                APPEND_TO_OUTPUT(NegVecF64x2)
+                APPEND_TO_OUTPUT(SqrtVecF64x2)
+                APPEND_TO_OUTPUT(CeilVecF64x2)
+                APPEND_TO_OUTPUT(FloorVecF64x2)
+                APPEND_TO_OUTPUT(TruncVecF64x2)
+                APPEND_TO_OUTPUT(NearestVecF64x2)
+                APPEND_TO_OUTPUT(ExtAddPairwiseSVecI8x16ToI16x8)
+                APPEND_TO_OUTPUT(ExtAddPairwiseUVecI8x16ToI16x8)
+                APPEND_TO_OUTPUT(ExtAddPairwiseSVecI16x8ToI32x4)
+                APPEND_TO_OUTPUT(ExtAddPairwiseUVecI16x8ToI32x4)
+                APPEND_TO_OUTPUT(TruncSatSVecF32x4ToVecI32x4)
+                APPEND_TO_OUTPUT(TruncSatUVecF32x4ToVecI32x4)
+                APPEND_TO_OUTPUT(ConvertSVecI32x4ToVecF32x4)
+                APPEND_TO_OUTPUT(ConvertUVecI32x4ToVecF32x4)
+                APPEND_TO_OUTPUT(ExtendLowSVecI8x16ToVecI16x8)
+                APPEND_TO_OUTPUT(ExtendHighSVecI8x16ToVecI16x8)
+                APPEND_TO_OUTPUT(ExtendLowUVecI8x16ToVecI16x8)
+                APPEND_TO_OUTPUT(ExtendHighUVecI8x16ToVecI16x8)
+                APPEND_TO_OUTPUT(ExtendLowSVecI16x8ToVecI32x4)
+                APPEND_TO_OUTPUT(ExtendHighSVecI16x8ToVecI32x4)
+                APPEND_TO_OUTPUT(ExtendLowUVecI16x8ToVecI32x4)
+                APPEND_TO_OUTPUT(ExtendHighUVecI16x8ToVecI32x4)
+                APPEND_TO_OUTPUT(ExtendLowSVecI32x4ToVecI64x2)
+                APPEND_TO_OUTPUT(ExtendHighSVecI32x4ToVecI64x2)
+                APPEND_TO_OUTPUT(ExtendLowUVecI32x4ToVecI64x2)
+                APPEND_TO_OUTPUT(ExtendHighUVecI32x4ToVecI64x2)
+                APPEND_TO_OUTPUT(ConvertLowSVecI32x4ToVecF64x2)
+                APPEND_TO_OUTPUT(ConvertLowUVecI32x4ToVecF64x2)
+                APPEND_TO_OUTPUT(TruncSatZeroSVecF64x2ToVecI32x4)
+                APPEND_TO_OUTPUT(TruncSatZeroUVecF64x2ToVecI32x4)
+                APPEND_TO_OUTPUT(DemoteZeroVecF64x2ToVecF32x4)
+                APPEND_TO_OUTPUT(PromoteLowVecF32x4ToVecF64x2)
+                APPEND_TO_OUTPUT(RelaxedTruncSVecF32x4ToVecI32x4)
+                APPEND_TO_OUTPUT(RelaxedTruncUVecF32x4ToVecI32x4)
+                APPEND_TO_OUTPUT(RelaxedTruncZeroSVecF64x2ToVecI32x4)
+                APPEND_TO_OUTPUT(RelaxedTruncZeroUVecF64x2ToVecI32x4)
+                APPEND_TO_OUTPUT(InvalidUnary)
+            }
+
+#undef APPEND_TO_OUTPUT
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, unaryInstruction->value);
+        }
+        context.expressionDepth--;
+        output << ")";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::UnreachableId:
+    {
+        if (context.expressionDepth == 0)
+            output.Indentation();
+        output << "assert(false)";
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::BinaryId:
+    {
+        wasm::Binary *instruction = static_cast<wasm::Binary *>(expression);
+
+        const char *vectorOperation = GetSimdOperationName(instruction->op);
+        if (frame.step == 0 && context.expressionDepth == 0)
+            output.Indentation() << "return ";
+
+        if (vectorOperation != nullptr)
+        {
+            if (frame.step == 0)
+                BeginWasm2cHelperCall(context, output, vectorOperation);
+            if (PushWasm2cHelperOperand(output, stack, {instruction->left, instruction->right}))
+                return;
+            EndWasm2cHelperCall(context, output);
+            if (context.expressionDepth == 0)
+                output << ";\n";
+            return PopEmitFrame(stack);
+        }
+
+        bool grouped;
+        switch (frame.step)
+        {
+        case 0:
+            grouped = instruction->left->_id == wasm::Expression::BinaryId || instruction->left->_id == wasm::Expression::UnaryId || instruction->left->_id == wasm::Expression::LocalSetId;
+            if (grouped)
+                output << "(";
+
+            if (instruction->left->_id == wasm::Expression::IfId)
+            {
+                output.Indent();
+                output << "(";
+            }
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, instruction->left);
+        case 1:
+            context.expressionDepth--;
+            if (instruction->left->_id == wasm::Expression::IfId)
+            {
+                output.Dedent();
+                output.Indentation() << ")";
+            }
+            grouped = instruction->left->_id == wasm::Expression::BinaryId || instruction->left->_id == wasm::Expression::UnaryId || instruction->left->_id == wasm::Expression::LocalSetId;
+            if (grouped)
+                output << ")";
+
+            switch (instruction->op)
+            {
+            case wasm::AddInt32:
+            case wasm::AddInt64:
+            case wasm::AddFloat32:
+            case wasm::AddFloat64:
+                output << " + ";
+                break;
+            case wasm::SubInt32:
+            case wasm::SubInt64:
+            case wasm::SubFloat32:
+            case wasm::SubFloat64:
+                output << " - ";
+                break;
+            case wasm::MulInt32:
+            case wasm::MulInt64:
+            case wasm::MulFloat32:
+            case wasm::MulFloat64:
+                output << " * ";
+                break;
+            case wasm::DivSInt32:
+            case wasm::DivUInt32:
+            case wasm::DivSInt64:
+            case wasm::DivUInt64:
+            case wasm::DivFloat32:
+            case wasm::DivFloat64:
+                output << " / ";
+                break;
+            case wasm::RemSInt32:
+            case wasm::RemUInt32:
+            case wasm::RemSInt64:
+            case wasm::RemUInt64:
+                output << " % ";
+                break;
+            case wasm::AndInt32:
+            case wasm::AndInt64:
+                output << " & ";
+                break;
+            case wasm::OrInt32:
+            case wasm::OrInt64:
+                output << " | ";
+                break;
+            case wasm::XorInt32:
+            case wasm::XorInt64:
+                output << " ^ ";
+                break;
+            case wasm::ShlInt32:
+            case wasm::ShlInt64:
+                output << " << ";
+                break;
+            case wasm::ShrSInt32:
+            case wasm::ShrUInt32:
+            case wasm::ShrSInt64:
+            case wasm::ShrUInt64:
+                output << " >> ";
+                break;
+            case wasm::RotLInt32:
+            case wasm::RotLInt64:
+                output << " <<< ";
+                break;
+            case wasm::RotRInt32:
+            case wasm::RotRInt64:
+                output << " >>> ";
+                break;
+            case wasm::EqInt32:
+            case wasm::EqInt64:
+            case wasm::EqFloat32:
+            case wasm::EqFloat64:
+                output << " == ";
+                break;
+            case wasm::NeInt32:
+            case wasm::NeInt64:
+            case wasm::NeFloat32:
+            case wasm::NeFloat64:
+                output << " != ";
+                break;
+            case wasm::LtSInt32:
+            case wasm::LtUInt32:
+            case wasm::LtSInt64:
+            case wasm::LtUInt64:
+            case wasm::LtFloat32:
+            case wasm::LtFloat64:
+                output << " < ";
+                break;
+            case wasm::LeSInt32:
+            case wasm::LeUInt32:
+            case wasm::LeSInt64:
+            case wasm::LeUInt64:
+            case wasm::LeFloat32:
+            case wasm::LeFloat64:
+                output << " <= ";
+                break;
+            case wasm::GtSInt32:
+            case wasm::GtUInt32:
+            case wasm::GtSInt64:
+            case wasm::GtUInt64:
+            case wasm::GtFloat32:
+            case wasm::GtFloat64:
+                output << " > ";
+                break;
+            case wasm::GeSInt32:
+            case wasm::GeUInt32:
+            case wasm::GeSInt64:
+            case wasm::GeUInt64:
+            case wasm::GeFloat32:
+            case wasm::GeFloat64:
+                output << " >= ";
+                break;
+            case wasm::MinFloat32:
+            case wasm::MinFloat64:
+                output << " min ";
+                break;
+            case wasm::MaxFloat32:
+            case wasm::MaxFloat64:
+                output << " max";
+                break;
+            case wasm::CopySignFloat32:
+            case wasm::CopySignFloat64:
+                output << " CopySign ";
+                break;
+            default:
+                Report("could not determine binary operator for #", std::to_string(instruction->op));
+                output << " #" << size_t(instruction->op) << " ";
+            }
+
+            grouped = instruction->right->_id == wasm::Expression::BinaryId || instruction->right->_id == wasm::Expression::UnaryId || instruction->right->_id == wasm::Expression::LocalSetId;
+            if (grouped)
+                output << "(";
+            if (instruction->right->_id == wasm::Expression::IfId)
+            {
+                output.Indent();
+                output << "(";
+            }
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 2, instruction->right);
+        }
+        context.expressionDepth--;
+        if (instruction->right->_id == wasm::Expression::IfId)
+        {
+            output.Dedent();
+            output.Indentation() << ")";
+        }
+        grouped = instruction->right->_id == wasm::Expression::BinaryId || instruction->right->_id == wasm::Expression::UnaryId || instruction->right->_id == wasm::Expression::LocalSetId;
+        if (grouped)
+            output << ")";
+
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::StoreId:
+    {
+        wasm::Store *instruction = static_cast<wasm::Store *>(expression);
+
+        if (frame.step == 0 && context.expressionDepth == 0)
+            output.Indentation();
+
+        // vectors are stored through a helper, which can use unaligned moves.
+        // a narrow store truncates its value with a cast
+        bool vector = instruction->bytes == 16;
+        bool truncated = instruction->bytes < instruction->valueType.getByteSize();
+        switch (frame.step)
+        {
+        case 0:
+            if (vector)
+            {
+                output << "__StoreVec128(";
+                BeginWasm2cMemoryAddress(context, output);
+                return PushEmitFrame(stack, 1, instruction->ptr);
+            }
+            if (instruction->bytes == 1 || instruction->bytes == 2 || instruction->bytes == 4 || instruction->bytes == 8)
+            {
+                output << "wasm_store_" << GetMemoryAccessName(instruction->valueType, instruction->bytes, false) << '(';
+                BeginWasm2cMemoryAccess(context, output, instruction->bytes, instruction->align.addr);
+                return PushEmitFrame(stack, 1, instruction->ptr);
+            }
+            Report("store with ", std::to_string(instruction->bytes), " not supported");
+            output << "unimplementedstore" << instruction->bytes << "(0";
+            [[fallthrough]];
+        case 1:
+            if (vector)
+                EndWasm2cMemoryAddress(context, output, instruction->offset.addr, instruction->bytes);
+            else if (frame.step == 1)
+                EndWasm2cMemoryAccess(context, output, instruction->offset.addr, instruction->bytes, instruction->align.addr);
+            output << ", ";
+            if (truncated)
+                output << (instruction->bytes == 1 ? "(uint8_t)(" : instruction->bytes == 2 ? "(uint16_t)(" : "(uint32_t)(");
+
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 2, instruction->value);
+        }
+        context.expressionDepth--;
+        output << (truncated ? "))" : ")");
+
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::ConstId:
+    {
+        wasm::Const *instruction = static_cast<wasm::Const *>(expression);
+
+        if (context.expressionDepth == 0)
+            output.Indentation() << "return ";
+        WriteWasm2cLiteral(output, instruction->value);
+
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::IfId:
+    {
+        wasm::If *instruction = static_cast<wasm::If *>(expression);
+
+        switch (frame.step)
+        {
+        case 0:
+            if (context.expressionDepth == 0)
+                output.Indentation();
+
+            BeginWasm2cCondition(context, output, frame);
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, instruction->condition);
+        case 1:
+            context.expressionDepth--;
+            EndWasm2cCondition(context, output, frame);
+
+            if (instruction->ifTrue->_id != wasm::Expression::BlockId)
+                output.Indent();
+            frame.savedDepth = context.expressionDepth;
+            context.expressionDepth = 0;
+            return PushEmitFrame(stack, 2, instruction->ifTrue);
+        case 2:
+            context.expressionDepth = frame.savedDepth;
+            if (instruction->ifTrue->_id != wasm::Expression::BlockId)
+                output.Dedent();
+
+            if (instruction->ifFalse != nullptr)
+            {
+                if (output.Back() != '\n')
+                    output << '\n';
+                output.Indentation() << "else\n";
+                if (instruction->ifFalse->_id != wasm::Expression::BlockId)
+                    output.Indent();
+
+                frame.savedDepth = context.expressionDepth;
+                context.expressionDepth = 0;
+                return PushEmitFrame(stack, 3, instruction->ifFalse);
+            }
+            break;
+        case 3:
+            context.expressionDepth = frame.savedDepth;
+            if (instruction->ifFalse->_id != wasm::Expression::BlockId)
+                output.Dedent();
+            break;
+        }
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::DropId:
+    {
+        wasm::Drop *instruction = static_cast<wasm::Drop *>(expression);
+
+        // the value is written in place of the drop
+        frame = {instruction->value};
+        return;
+    }
+    case wasm::Expression::SwitchId:
+    {
+        wasm::Switch *instruction = static_cast<wasm::Switch *>(expression);
+
+        switch (frame.step)
+        {
+        case 0:
+            // blocks have no result variable to pass the value in
+            if (instruction->value != nullptr)
+            {
+                Report("br_table with a value not supported");
+                output.Indentation() << "unimplementedbrtablevalue(";
+                context.expressionDepth++;
+                return PushEmitFrame(stack, 1, instruction->value);
+            }
+            [[fallthrough]];
+        case 1:
+            if (instruction->value != nullptr)
+            {
+                context.expressionDepth--;
+                output << ");\n";
+            }
+            frame.switchRanges = GetWasm2cSwitchRanges(instruction);
+            if (IsWasm2cJumpTable(frame.switchRanges))
+            {
+                output.Indentation() << "{\n";
+                output.Indent();
+                output.Indentation() << "uint32_t index = (uint32_t)(";
+            }
+            else
+                output.Indentation() << "switch ((uint32_t)(";
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 2, instruction->condition);
+        }
+        context.expressionDepth--;
+
+        if (IsWasm2cJumpTable(frame.switchRanges))
+        {
+            output << ");\n";
+            WriteWasm2cJumpTable(context, output, instruction);
+            output.Dedent();
+            output.Indentation() << "}\n";
+        }
+        else
+        {
+            output << "))\n";
+            WriteWasm2cSwitchCases(context, output, instruction, frame.switchRanges);
+        }
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::ReturnId:
+    {
+        wasm::Return *instruction = static_cast<wasm::Return *>(expression);
+
+        if (frame.step == 0)
+        {
+            output.Indentation() << "return";
+            if (instruction->value != nullptr)
+            {
+                output << " ";
+                context.expressionDepth++;
+                return PushEmitFrame(stack, 1, instruction->value);
+            }
+        }
+        else
+            context.expressionDepth--;
+        output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::GlobalSetId:
+    {
+        wasm::GlobalSet *instruction = static_cast<wasm::GlobalSet *>(expression);
+
+        if (frame.step == 0)
+        {
+            output.Indentation() << instruction->name.str << " = ";
+
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, instruction->value);
+        }
+        context.expressionDepth--;
+
+        output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::GlobalGetId:
+    {
+        wasm::GlobalGet *instruction = static_cast<wasm::GlobalGet *>(expression);
+
+        if (context.expressionDepth == 0)
+            output.Indentation();
+
+        // a global never written reads as its value, so the C compiler can
+        // fold it
+        wasm::Expression *value = nullptr;
+        if (context.constantGlobals != nullptr)
+        {
+            auto constant = context.constantGlobals->find(instruction->name.str);
+            if (constant != context.constantGlobals->end())
+                value = constant->second;
+        }
+
+        if (value == nullptr)
+            output << instruction->name.str;
+        else if (wasm::Const *literal = value->dynCast<wasm::Const>())
+            WriteWasm2cLiteral(output, literal->value);
+        else
+            output << value->cast<wasm::GlobalGet>()->name.str;
+
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::LoopId:
+    {
+        wasm::Loop *instruction = static_cast<wasm::Loop *>(expression);
+        if (instruction->name.str != nullptr && context.switchTargets.count(instruction->name.str) != 0)
+            output.Indentation() << instruction->name.str << ":\n";
+        output.Indentation() << "while (true)\n";
+        frame = {instruction->body};
+        return;
+    }
+    case wasm::Expression::SelectId:
+    {
+        wasm::Select *instruction = static_cast<wasm::Select *>(expression);
+
+        switch (frame.step)
+        {
+        case 0:
+            if (context.expressionDepth == 0)
+                output.Indentation();
+
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, instruction->condition);
+        case 1:
+            context.expressionDepth--;
+
+            output << " ? ";
+
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 2, instruction->ifTrue);
+        case 2:
+            context.expressionDepth--;
+
+            output << " : ";
+
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 3, instruction->ifFalse);
+        }
+        context.expressionDepth--;
+
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::MemorySizeId:
+    {
+        output << "MEMORY_SIZE";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::MemoryGrowId:
+    {
+        wasm::MemoryGrow *instruction = static_cast<wasm::MemoryGrow *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation();
+
+            output << "MEMORY_GROW(";
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 1, instruction->delta);
+        }
+        context.expressionDepth--;
+        output << ")";
+
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::NopId:
+    {
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::MemoryCopyId:
+    {
+        wasm::MemoryCopy *instruction = static_cast<wasm::MemoryCopy *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation();
+            BeginWasm2cHelperCall(context, output, "wasm_memory_copy");
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->dest, instruction->source, instruction->size}))
+            return;
+        EndWasm2cHelperCall(context, output);
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::MemoryFillId:
+    {
+        wasm::MemoryFill *instruction = static_cast<wasm::MemoryFill *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation();
+            BeginWasm2cHelperCall(context, output, "wasm_memory_fill");
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->dest, instruction->value, instruction->size}))
+            return;
+        EndWasm2cHelperCall(context, output);
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::MemoryInitId:
+    {
+        wasm::MemoryInit *instruction = static_cast<wasm::MemoryInit *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation();
+            BeginWasm2cHelperCall(context, output, "wasm_memory_init");
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->dest, instruction->offset, instruction->size}))
+            return;
+        EndWasm2cHelperCall(context, output, std::to_string(instruction->segment));
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::DataDropId:
+    {
+        wasm::DataDrop *instruction = static_cast<wasm::DataDrop *>(expression);
+
+        if (context.expressionDepth == 0)
+            output.Indentation();
+        output << "wasm_data_segment_sizes[" << instruction->segment << "] = 0";
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::CallIndirectId:
+    {
+        wasm::CallIndirect *instruction = static_cast<wasm::CallIndirect *>(expression);
+        switch (frame.step)
+        {
+        case 0:
+        {
+            wasm::Signature signature = instruction->heapType.getSignature();
+            if (context.expressionDepth == 0)
+                output.Indentation();
+
+            // a constant index into a constant table calls its function directly
+            wasm::Function *target = nullptr;
+            wasm::Const *index = instruction->target->dynCast<wasm::Const>();
+            if (index != nullptr && context.table != nullptr && context.table->constant && uint32_t(index->value.geti32()) < context.table->slots.size())
+                target = context.table->slots[uint32_t(index->value.geti32())];
+
+            context.expressionDepth++;
+            if (target != nullptr && target->getSig() == signature)
+                output << "func" << target->name.str << "(";
+            else
+            {
+                output << "wasm_call_indirect_" << GetSignatureName(signature) << "(";
+                return PushEmitFrame(stack, 1, instruction->target);
+            }
+            break;
+        }
+        case 1:
+            if (!instruction->operands.empty())
+                output << ", ";
+            break;
+        default:
+            if (frame.index != instruction->operands.size() - 1)
+                output << ", ";
+            frame.index++;
+        }
+        if (frame.index < instruction->operands.size())
+            return PushEmitFrame(stack, 2, instruction->operands[frame.index]);
+        output << ")";
+        context.expressionDepth--;
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDExtractId:
+    {
+        wasm::SIMDExtract *instruction = static_cast<wasm::SIMDExtract *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+            BeginWasm2cHelperCall(context, output, GetSimdOperationName(instruction->op));
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->vec}))
+            return;
+        EndWasm2cHelperCall(context, output, std::to_string(instruction->index));
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDReplaceId:
+    {
+        wasm::SIMDReplace *instruction = static_cast<wasm::SIMDReplace *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+            BeginWasm2cHelperCall(context, output, GetSimdOperationName(instruction->op));
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->vec, instruction->value}))
+            return;
+        EndWasm2cHelperCall(context, output, std::to_string(instruction->index));
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDShuffleId:
+    {
+        wasm::SIMDShuffle *instruction = static_cast<wasm::SIMDShuffle *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+            BeginWasm2cHelperCall(context, output, "__ShuffleVecI8x16");
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->left, instruction->right}))
+            return;
+        // the lane indexes packed into two little endian words
+        uint64_t mask[2];
+        std::memcpy(mask, instruction->mask.data(), sizeof(mask));
+        char immediates[64];
+        std::snprintf(immediates, sizeof(immediates), "0x%016llxull, 0x%016llxull", (unsigned long long)mask[0], (unsigned long long)mask[1]);
+        EndWasm2cHelperCall(context, output, immediates);
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDTernaryId:
+    {
+        wasm::SIMDTernary *instruction = static_cast<wasm::SIMDTernary *>(expression);
+
+        const char *name = GetSimdOperationName(instruction->op);
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+            if (name != nullptr)
+                BeginWasm2cHelperCall(context, output, name);
+            else
+            {
+                Report("vector ternary operation #", std::to_string(instruction->op), " not supported");
+                output << "unimplementedternary" << size_t(instruction->op);
+            }
+        }
+        if (name != nullptr)
+        {
+            if (PushWasm2cHelperOperand(output, stack, {instruction->a, instruction->b, instruction->c}))
+                return;
+            EndWasm2cHelperCall(context, output);
+        }
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDShiftId:
+    {
+        wasm::SIMDShift *instruction = static_cast<wasm::SIMDShift *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+            BeginWasm2cHelperCall(context, output, GetSimdOperationName(instruction->op));
+        }
+        if (PushWasm2cHelperOperand(output, stack, {instruction->vec, instruction->shift}))
+            return;
+        EndWasm2cHelperCall(context, output);
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDLoadId:
+    {
+        wasm::SIMDLoad *instruction = static_cast<wasm::SIMDLoad *>(expression);
+
+        if (frame.step == 0)
+        {
+            if (context.expressionDepth == 0)
+                output.Indentation() << "return ";
+            output << GetSimdOperationName(instruction->op) << '(';
+            BeginWasm2cMemoryAddress(context, output);
+            return PushEmitFrame(stack, 1, instruction->ptr);
+        }
+        EndWasm2cMemoryAddress(context, output, instruction->offset.addr, instruction->getMemBytes());
+        output << ')';
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    case wasm::Expression::SIMDLoadStoreLaneId:
+    {
+        wasm::SIMDLoadStoreLane *instruction = static_cast<wasm::SIMDLoadStoreLane *>(expression);
+
+        switch (frame.step)
+        {
+        case 0:
+            if (context.expressionDepth == 0)
+            {
+                output.Indentation();
+                if (!instruction->isStore())
+                    output << "return ";
+            }
+            output << GetSimdOperationName(instruction->op) << '(';
+            BeginWasm2cMemoryAddress(context, output);
+            return PushEmitFrame(stack, 1, instruction->ptr);
+        case 1:
+            EndWasm2cMemoryAddress(context, output, instruction->offset.addr, instruction->getMemBytes());
+            output << ", ";
+            context.expressionDepth++;
+            return PushEmitFrame(stack, 2, instruction->vec);
+        }
+        context.expressionDepth--;
+        output << ", " << instruction->index << ')';
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    default:
+    {
+        if (context.expressionDepth == 0)
+            output.Indentation();
+        output << "unimplemented" << size_t(id);
+        if (context.expressionDepth == 0)
+            output << ";\n";
+        return PopEmitFrame(stack);
+    }
+    }
+}
+// writes an expression tree. the pending expressions live on an explicit
+// stack rather than the native one, so there is no limit on how deeply the
+// tree may be nested
+void GetWasm2cExperssion(EmitterContext &context, CodeWriter &output, wasm::Expression *expression)
+{
+    std::vector<EmitFrame> stack;
+    stack.push_back({expression});
+    while (!stack.empty())
+        ResumeWasm2cExpression(context, output, stack);
+}
+void GetWasm2cFunctionBody(EmitterContext &context, CodeWriter &output, wasm::Function *function)
+{
+    if (function->body == nullptr)
+    {
+        output << "// imported\n";
+        return;
+    }
+
+    GetWasm2cExperssion(context, output, function->body);
+}
+void GetWasm2cFunctionLocals(CodeWriter &output, wasm::Function *function)
+{
+    for (size_t i = function->getNumParams() - 1; i < function->getNumVars(); i++)
+    {
+        wasm::Type type = function->getLocalType(i);
+
+        output.Indentation() << GetStringFromWasmType(type) << ' ';
+        output.Local(i + 1) << ";\n";
+    }
+}
+// numbers the ifs and br_ifs of a function in the order of their opcodes in
+// the wasm code, which is how the branches of a profile are counted: an if
+// after its condition and before its arms, a br_if after its operands
+struct BranchOrderScanner : public wasm::PostWalker<BranchOrderScanner>
+{
+    std::unordered_map<wasm::Expression *, size_t> branches;
+
+    static void scan(BranchOrderScanner *self, wasm::Expression **currp)
+    {
+        if (wasm::If *instruction = (*currp)->dynCast<wasm::If>())
+        {
+            self->maybePushTask(scan, &instruction->ifFalse);
+            self->pushTask(scan, &instruction->ifTrue);
+            self->pushTask(doVisitIfOpcode, currp);
+            self->pushTask(scan, &instruction->condition);
+            return;
+        }
+        wasm::PostWalker<BranchOrderScanner>::scan(self, currp);
+    }
+    static void doVisitIfOpcode(BranchOrderScanner *self, wasm::Expression **currp)
+    {
+        self->branches.emplace(*currp, self->branches.size());
+    }
+    void visitBreak(wasm::Break *instruction)
+    {
+        if (instruction->condition != nullptr)
+            branches.emplace(instruction, branches.size());
+    }
+};
+// the labels the br_tables of a function jump to, and which of them are
+// loops, whose label goes before the loop rather than after it
+struct BranchTableScanner : public wasm::PostWalker<BranchTableScanner>
+{
+    std::unordered_set<std::string_view> targets;
+    std::unordered_set<std::string_view> loops;
+
+    void visitSwitch(wasm::Switch *instruction)
+    {
+        for (wasm::Name target : instruction->targets)
+            targets.insert(target.str);
+        targets.insert(instruction->default_.str);
+    }
+    void visitLoop(wasm::Loop *instruction)
+    {
+        if (instruction->name.str != nullptr)
+            loops.insert(instruction->name.str);
+    }
+};
+CodeWriter GenerateWasm2cFunction(wasm::Function *function, const Wasm2cOptions &options, const TableLayout &table, const ConstantGlobals &constantGlobals, const FunctionProfile *profile = nullptr, FunctionHeat heat = FunctionHeat::Unknown, bool inlined = false)
+{
+    EmitterContext context;
+    context.memoryMode = options.memoryMode;
+    context.table = &table;
+    context.constantGlobals = &constantGlobals;
+    context.profile = profile;
+    if (function->body != nullptr)
+    {
+        BranchTableScanner scanner;
+        scanner.walk(function->body);
+        context.switchTargets = std::move(scanner.targets);
+        context.loops = std::move(scanner.loops);
+    }
+    if (profile != nullptr && !profile->branches.empty())
+    {
+        BranchOrderScanner scanner;
+        scanner.walk(function->body);
+        context.branchIndices = std::move(scanner.branches);
+    }
+    CodeWriter output;
+
+    if (inlined)
+        output << "static inline ";
+    if (heat == FunctionHeat::Hot)
+        output << "__attribute__((hot)) ";
+    else if (heat == FunctionHeat::Cold)
+        output << "__attribute__((cold)) ";
+    WriteFunctionSignature(output, function);
+
+    output << "\n{\n"; // open function body
+    output.Indent();
+
+    GetWasm2cFunctionLocals(output, function);
+    GetWasm2cFunctionBody(context, output, function);
+
+    output.Dedent();
+    output << "}";
+    output << "\n\n";
+
+    return output;
+}
+// 64 bit FNV-1a over the structure of wasm IR. names are hashed by their
+// text rather than their interned address, so the digest of a function is
+// the same in every run
+class StableHasher
+{
+public:
+    void Add(const void *data, size_t size)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            digest ^= bytes[i];
+            digest *= 0x100000001b3;
+        }
+    }
+    void Add(uint64_t value)
+    {
+        Add(&value, sizeof(value));
+    }
+    void Add(std::string_view text)
+    {
+        Add(uint64_t(text.size()));
+        Add(text.data(), text.size());
+    }
+    void AddName(wasm::Name name)
+    {
+        Add(name.str != nullptr ? std::string_view(name.str) : std::string_view());
+    }
+    void AddType(wasm::Type type)
+    {
+        if (type.isBasic())
+        {
+            Add(uint64_t(type.getBasic()));
+            return;
+        }
+
+        // compound type ids are pointers, so hash how the type prints
+        std::ostringstream stream;
+        stream << type;
+        Add(stream.str());
+    }
+    void AddHeapType(wasm::HeapType type)
+    {
+        std::ostringstream stream;
+        stream << type;
+        Add(stream.str());
+    }
+    void AddLiteral(const wasm::Literal &literal)
+    {
+        AddType(literal.type);
+
+        if (literal.type == wasm::Type::v128)
+        {
+            std::array<uint8_t, 16> bytes = literal.getv128();
+            Add(bytes.data(), bytes.size());
+        }
+        else if (literal.type.isNumber())
+            Add(uint64_t(literal.getBits()));
+        else if (literal.isFunction())
+            AddName(literal.getFunc());
+    }
+    // walks the tree with an explicit stack so deeply nested bodies cannot
+    // overflow the native one
+    void AddExpression(wasm::Expression *root)
+    {
+        using namespace wasm;
+
+        std::vector<Expression *> stack = {root};
+        while (!stack.empty())
+        {
+            Expression *expression = stack.back();
+            stack.pop_back();
+
+            if (expression == nullptr)
+            {
+                Add(uint64_t(0));
+                continue;
+            }
+
+            Add(uint64_t(expression->_id) + 1);
+            AddType(expression->type);
+
+#define DELEGATE_ID expression->_id
+#define DELEGATE_START(id) [[maybe_unused]] auto *cast = expression->cast<id>();
+#define DELEGATE_GET_FIELD(id, field) cast->field
+#define DELEGATE_FIELD_CHILD(id, field) stack.push_back(cast->field);
+#define DELEGATE_FIELD_OPTIONAL_CHILD(id, field) stack.push_back(cast->field);
+#define DELEGATE_FIELD_CHILD_VECTOR(id, field) \
+    Add(uint64_t(cast->field.size()));         \
+    for (Expression * child : cast->field)     \
+        stack.push_back(child);
+#define DELEGATE_FIELD_INT(id, field) Add(uint64_t(cast->field));
+#define DELEGATE_FIELD_INT_ARRAY(id, field) \
+    for (auto value : cast->field)          \
+        Add(uint64_t(value));
+#define DELEGATE_FIELD_LITERAL(id, field) AddLiteral(cast->field);
+#define DELEGATE_FIELD_NAME(id, field) AddName(cast->field);
+#define DELEGATE_FIELD_NAME_VECTOR(id, field) \
+    Add(uint64_t(cast->field.size()));        \
+    for (Name name : cast->field)             \
+        AddName(name);
+#define DELEGATE_FIELD_SCOPE_NAME_DEF(id, field) AddName(cast->field);
+#define DELEGATE_FIELD_SCOPE_NAME_USE(id, field) AddName(cast->field);
+#define DELEGATE_FIELD_SCOPE_NAME_USE_VECTOR(id, field) DELEGATE_FIELD_NAME_VECTOR(id, field)
+#define DELEGATE_FIELD_SIGNATURE(id, field) \
+    AddType(cast->field.params);            \
+    AddType(cast->field.results);
+#define DELEGATE_FIELD_TYPE(id, field) AddType(cast->field);
+#define DELEGATE_FIELD_HEAPTYPE(id, field) AddHeapType(cast->field);
+#define DELEGATE_FIELD_ADDRESS(id, field) Add(uint64_t(cast->field.addr));
+
+#include <wasm-delegations-fields.def>
+        }
+    }
+
+    // the signature, locals and body of a function, everything about it
+    // but its name
+    void AddFunctionStructure(wasm::Function *function)
+    {
+        wasm::Signature signature = function->getSig();
+        AddType(signature.params);
+        AddType(signature.results);
+        Add(uint64_t(function->vars.size()));
+        for (wasm::Type type : function->vars)
+            AddType(type);
+
+        if (function->body != nullptr)
+            AddExpression(function->body);
+    }
+
+    uint64_t Digest() const
+    {
+        return digest;
+    }
+
+private:
+    uint64_t digest = 0xcbf29ce484222325;
+};
+// finds the table slots called through a constant index and the globals
+// read
+struct ConstantIndirectCallScanner : public wasm::PostWalker<ConstantIndirectCallScanner>
+{
+    std::vector<uint32_t> slots;
+    std::vector<wasm::Name> globals;
+
+    void visitCallIndirect(wasm::CallIndirect *call)
+    {
+        if (wasm::Const *index = call->target->dynCast<wasm::Const>())
+            slots.push_back(uint32_t(index->value.geti32()));
+    }
+    void visitGlobalGet(wasm::GlobalGet *get)
+    {
+        globals.push_back(get->name);
+    }
+};
+// hash of everything that determines a function's emitted C: its name,
+// signature, locals and body, the functions in the table slots it calls
+// directly, the values of the constant globals it reads, what the profile
+// makes of it and whether it is inlined
+uint64_t HashFunction(wasm::Function *function, const TableLayout &table, const ConstantGlobals &constantGlobals, const FunctionProfile *profile, FunctionHeat heat, bool inlined)
+{
+    StableHasher hasher;
+
+    hasher.AddName(function->name);
+    hasher.AddFunctionStructure(function);
+    hasher.Add(uint64_t(inlined));
+
+    // only what the profile changes in the C, so new counts that do not
+    // move a function or branch across a threshold keep it cached
+    hasher.Add(uint64_t(heat));
+    if (profile != nullptr)
+        for (size_t branch = 0; branch < profile->branches.size(); branch++)
+            hasher.Add(uint64_t(GetBranchExpectation(profile, branch) + 1));
+
+    if (function->body != nullptr)
+    {
+        ConstantIndirectCallScanner scanner;
+        scanner.walk(function->body);
+        if (table.constant)
+            for (uint32_t slot : scanner.slots)
+                if (slot < table.slots.size() && table.slots[slot] != nullptr)
+                    hasher.AddName(table.slots[slot]->name);
+        for (wasm::Name global : scanner.globals)
+        {
+            auto constant = constantGlobals.find(global.str);
+            if (constant != constantGlobals.end())
+                hasher.AddExpression(constant->second);
+        }
+    }
+
+    return hasher.Digest();
+}
+// identifies everything besides the function itself that changes the C
+// emitted for it: the version of the emitted C and the options the emitter
+// reads. the rest, like inlining and the profile, is part of HashFunction
+uint64_t EmitterFingerprint(const Wasm2cOptions &options)
+{
+    // bump whenever the C emitted for a function changes, so the caches
+    // written by older builds are discarded
+    constexpr uint64_t emitterVersion = 1;
+
+    StableHasher hasher;
+    hasher.Add(emitterVersion);
+    hasher.Add(uint64_t(options.memoryMode));
+    return hasher.Digest();
+}
+// on-disk cache of emitted function bodies keyed by HashFunction, so that
+// rerunning on a new build of the same module only emits the functions that
+// changed. entries of the previous run are read on demand, the entries of
+// this run are streamed to a new file that replaces the old one in Commit()
+class FunctionCache
+{
+public:
+    FunctionCache(const std::string &path, uint64_t fingerprint)
+        : path(path), temporaryPath(path + ".tmp"), fingerprint(fingerprint)
+    {
+        LoadIndex();
+
+        nextFile.open(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!nextFile.is_open())
+        {
+            Report("could not open cache file path ", temporaryPath);
+            throw std::runtime_error("unable to open cache file");
+        }
+        nextFile.write(magic, sizeof(magic));
+        WriteValue(fingerprint);
+    }
+    ~FunctionCache()
+    {
+        if (!committed)
+        {
+            nextFile.close();
+            std::error_code error;
+            std::filesystem::remove(temporaryPath, error);
+        }
+    }
+
+    // safe to call from several threads at once
+    bool Lookup(uint64_t hash, CodeWriter &output)
+    {
+        auto entry = previousEntries.find(hash);
+        if (entry == previousEntries.end())
+        {
+            misses++;
+            return false;
+        }
+
+        std::string text(entry->second.second, '\0');
+        {
+            std::lock_guard<std::mutex> lock(previousMutex);
+            previousFile.seekg(entry->second.first);
+            previousFile.read(text.data(), text.size());
+            if (!previousFile)
+            {
+                previousFile.clear();
+                misses++;
+                return false;
+            }
+        }
+
+        output << text;
+        hits++;
+        return true;
+    }
+    void Store(uint64_t hash, const CodeWriter &body)
+    {
+        WriteValue(hash);
+        WriteValue(body.Size());
+
+        StreamOutputSink sink(nextFile);
+        body.WriteTo(sink);
+    }
+    void Commit()
+    {
+        previousFile.close();
+        nextFile.close();
+        std::filesystem::rename(temporaryPath, path);
+        committed = true;
+    }
+
+    size_t Hits() const
+    {
+        return hits;
+    }
+    size_t Misses() const
+    {
+        return misses;
+    }
+
+private:
+    static constexpr char magic[8] = {'w', '2', 'c', 'c', 'a', 'c', 'h', 'e'};
+
+    void LoadIndex()
+    {
+        previousFile.open(path, std::ios::binary);
+        if (!previousFile.is_open())
+            return;
+
+        char fileMagic[sizeof(magic)];
+        uint64_t fileFingerprint;
+        // cached text is only valid for the emitter build and options that
+        // produced it
+        if (!previousFile.read(fileMagic, sizeof(fileMagic)) || std::memcmp(fileMagic, magic, sizeof(magic)) != 0 || !ReadValue(fileFingerprint) || fileFingerprint != fingerprint)
+        {
+            previousFile.close();
+            return;
+        }
+
+        uint64_t hash;
+        uint64_t size;
+        while (ReadValue(hash) && ReadValue(size))
+        {
+            previousEntries[hash] = {uint64_t(previousFile.tellg()), size};
+            previousFile.seekg(size, std::ios::cur);
+        }
+        previousFile.clear();
+    }
+    bool ReadValue(uint64_t &value)
+    {
+        return bool(previousFile.read(reinterpret_cast<char *>(&value), sizeof(value)));
+    }
+    void WriteValue(uint64_t value)
+    {
+        nextFile.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    std::string path;
+    std::string temporaryPath;
+    uint64_t fingerprint;
+    std::ifstream previousFile;
+    std::mutex previousMutex;
+    // hash -> offset and size of the cached text in previousFile
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> previousEntries;
+    std::ofstream nextFile;
+    bool committed = false;
+    std::atomic<size_t> hits = 0;
+    std::atomic<size_t> misses = 0;
+};
+double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+size_t ResolveJobCount(size_t jobs, size_t count)
+{
+    if (jobs == 0)
+        jobs = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    return std::min(jobs, count);
+}
+// runs produce(0) .. produce(count - 1) on up to `jobs` threads and hands
+// each result to consume() on the calling thread in index order. idle
+// workers claim the next unstarted index, but never run more than a few
+// items ahead of the consumer, so only a handful of results are buffered
+template <typename Result>
+void OrderedParallelFor(size_t count, size_t jobs, const std::function<Result(size_t)> &produce, const std::function<void(Result &)> &consume)
+{
+    jobs = ResolveJobCount(jobs, count);
+
+    if (jobs <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            Result result = produce(i);
+            consume(result);
+        }
+        return;
+    }
+
+    const size_t window = jobs * 4;
+
+    std::vector<Result> results(count);
+    std::vector<bool> ready(count, false);
+    size_t nextIndex = 0;
+    size_t consumed = 0;
+    std::mutex mutex;
+    std::condition_variable producedCondition;
+    std::condition_variable consumedCondition;
+
+    // the workers report to the diagnostics of the calling thread
+    Diagnostics *diagnostics = currentDiagnostics;
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+    for (size_t worker = 0; worker < jobs; worker++)
+        workers.emplace_back([&]()
+                             {
+                                 ScopedDiagnostics scope(diagnostics);
+                                 while (true)
+                                 {
+                                     size_t index;
+                                     {
+                                         std::unique_lock<std::mutex> lock(mutex);
+                                         consumedCondition.wait(lock, [&]()
+                                                                { return nextIndex >= count || nextIndex < consumed + window; });
+                                         if (nextIndex >= count)
+                                             return;
+                                         index = nextIndex++;
+                                     }
+
+                                     Result result = produce(index);
+
+                                     {
+                                         std::lock_guard<std::mutex> lock(mutex);
+                                         results[index] = std::move(result);
+                                         ready[index] = true;
+                                     }
+                                     producedCondition.notify_one();
+                                 }
+                             });
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Result result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            producedCondition.wait(lock, [&]()
+                                   { return ready[i]; });
+            result = std::move(results[i]);
+            consumed = i + 1;
+        }
+        consumedCondition.notify_all();
+
+        consume(result);
+    }
+
+    for (std::thread &worker : workers)
+        worker.join();
+}
+// what is emitted for a module, decided before any C is written
+struct EmitPlan
+{
+    // functions to declare and define, in module order
+    std::vector<wasm::Function *> functions;
+    // file receiving the data segments, and the sink taking its place for
+    // the library
+    std::string dataFile;
+    OutputSink *dataSink = nullptr;
+    TableLayout table;
+    // whether the output needs wasm2c_simd.h
+    bool usesSimd = false;
+    // whether the bulk memory helpers are needed, and memory.init among them
+    bool usesBulkMemory = false;
+    bool usesMemoryInit = false;
+    // set when the function bodies are parsed a chunk at a time, with the
+    // first chunk as left parsed by the summaries until its emission takes
+    // it
+    const StreamedCodeSection *stream = nullptr;
+    mutable std::unique_ptr<wasm::Module> firstChunk;
+    // functions emitting the same C as an earlier one but for their name.
+    // they become a #define of it, or a call to it when exported since
+    // exports need a symbol of their own
+    struct Duplicate
+    {
+        wasm::Function *canonical = nullptr;
+        bool exported = false;
+    };
+    std::unordered_map<wasm::Function *, Duplicate> duplicates;
+    // the --profile counts by function name, and the functions found hot
+    // or cold in them. by name, since a streamed function is emitted from
+    // a chunk rather than the planned module
+    std::unordered_map<std::string, FunctionProfile> profile;
+    std::unordered_map<std::string, FunctionHeat> heat;
+    // small functions calling nothing, emitted as static inline so every
+    // call to them can be inlined. sharded output defines them in the
+    // header to reach the calls of every shard. by name like the profile,
+    // and how many calls and ref.funcs name them
+    std::unordered_set<std::string> inlined;
+    size_t inlinedCallSites = 0;
+    // the globals no planned function writes and the host cannot either
+    ConstantGlobals constantGlobals;
+
+    const FunctionProfile *GetProfile(wasm::Function *function) const
+    {
+        auto found = profile.find(function->name.str);
+        return found != profile.end() ? &found->second : nullptr;
+    }
+    FunctionHeat GetHeat(wasm::Function *function) const
+    {
+        auto found = heat.find(function->name.str);
+        return found != heat.end() ? found->second : FunctionHeat::Unknown;
+    }
+    bool IsInlined(wasm::Function *function) const
+    {
+        return inlined.count(function->name.str) != 0;
+    }
+};
+// finds the functions a function refers to directly, and the globals it
+// writes
+struct CallGraphScanner : public wasm::PostWalker<CallGraphScanner>
+{
+    std::vector<wasm::Name> callees;
+    std::vector<wasm::Name> globalsSet;
+    bool callsIndirectly = false;
+    std::vector<wasm::Signature> indirectSignatures;
+    std::vector<uint32_t> constantSlots;
+
+    void visitCall(wasm::Call *call)
+    {
+        callees.push_back(call->target);
+    }
+    void visitCallIndirect(wasm::CallIndirect *call)
+    {
+        callsIndirectly = true;
+        indirectSignatures.push_back(call->heapType.getSignature());
+        if (wasm::Const *index = call->target->dynCast<wasm::Const>())
+            constantSlots.push_back(uint32_t(index->value.geti32()));
+    }
+    void visitRefFunc(wasm::RefFunc *reference)
+    {
+        callees.push_back(reference->func);
+    }
+    void visitGlobalSet(wasm::GlobalSet *set)
+    {
+        globalsSet.push_back(set->name);
+    }
+};
+// finds the instructions needing runtime support: the bulk memory ones, and
+// any expression producing a vector. every simd instruction has a vector
+// operand or result, so this finds them all. counts the expressions on the
+// way, as the size of the function
+struct FeatureScanner : public wasm::PostWalker<FeatureScanner, wasm::UnifiedExpressionVisitor<FeatureScanner>>
+{
+    bool simd = false;
+    bool bulkMemory = false;
+    bool memoryInit = false;
+    size_t expressions = 0;
+
+    void visitExpression(wasm::Expression *expression)
+    {
+        expressions++;
+        switch (expression->_id)
+        {
+        case wasm::Expression::MemoryInitId:
+        case wasm::Expression::DataDropId:
+            memoryInit = true;
+            bulkMemory = true;
+            break;
+        case wasm::Expression::MemoryCopyId:
+        case wasm::Expression::MemoryFillId:
+            bulkMemory = true;
+            break;
+        default:
+            break;
+        }
+        if (expression->type == wasm::Type::v128)
+            simd = true;
+    }
+};
+// what planning needs from a function body: the functions it refers to, the
+// globals it writes, the signatures it calls indirectly, the runtime support it needs, its size in
+// expressions and, when looking for duplicates, a digest of the function
+// without its name
+struct FunctionSummary
+{
+    std::vector<wasm::Name> callees;
+    std::vector<wasm::Name> globalsSet;
+    bool callsIndirectly = false;
+    std::vector<wasm::Signature> indirectSignatures;
+    std::vector<uint32_t> constantSlots;
+    bool simd = false;
+    bool bulkMemory = false;
+    bool memoryInit = false;
+    size_t expressions = 0;
+    uint64_t digest = 0;
+};
+FunctionSummary SummarizeFunction(wasm::Function *function, bool digest)
+{
+    FunctionSummary summary;
+    if (function->body == nullptr)
+        return summary;
+
+    CallGraphScanner calls;
+    calls.walk(function->body);
+    summary.callees = std::move(calls.callees);
+    summary.globalsSet = std::move(calls.globalsSet);
+    summary.callsIndirectly = calls.callsIndirectly;
+    summary.indirectSignatures = std::move(calls.indirectSignatures);
+    summary.constantSlots = std::move(calls.constantSlots);
+
+    FeatureScanner features;
+    features.walk(function->body);
+    summary.simd = features.simd;
+    summary.bulkMemory = features.bulkMemory;
+    summary.memoryInit = features.memoryInit;
+    summary.expressions = features.expressions;
+
+    if (digest)
+    {
+        StableHasher hasher;
+        hasher.AddFunctionStructure(function);
+        summary.digest = hasher.Digest();
+    }
+
+    return summary;
+}
+// the summaries of a parsed module are made the first time planning asks
+// for them. a streamed module has every body summarized up front, since its
+// functions only hold a placeholder body
+class FunctionSummaries
+{
+public:
+    FunctionSummaries(bool digests) : digests(digests)
+    {
+    }
+    const FunctionSummary &Get(wasm::Function *function)
+    {
+        auto found = summaries.find(function);
+        if (found == summaries.end())
+            found = summaries.emplace(function, SummarizeFunction(function, digests)).first;
+        return found->second;
+    }
+    void Set(wasm::Function *function, FunctionSummary summary)
+    {
+        summaries[function] = std::move(summary);
+    }
+
+    bool Digests() const
+    {
+        return digests;
+    }
+
+private:
+    bool digests;
+    std::unordered_map<wasm::Function *, FunctionSummary> summaries;
+};
+// summarizes the bodies of a streamed module a chunk at a time, last chunk
+// first. the first chunk is emitted first, so its module is returned for
+// the emission to start with rather than parsed again, and a module that
+// fits one chunk is parsed only once
+std::unique_ptr<wasm::Module> SummarizeStreamedFunctions(wasm::Module *module, const StreamedCodeSection &stream, FunctionSummaries &summaries)
+{
+    size_t firstBody = module->functions.size() - stream.Bodies();
+    std::unique_ptr<wasm::Module> chunkModule;
+    for (size_t chunk = stream.Chunks(); chunk-- > 0;)
+    {
+        chunkModule = stream.ParseChunk(chunk);
+        for (size_t i = firstBody + stream.ChunkBegin(chunk); i < firstBody + stream.ChunkEnd(chunk); i++)
+            summaries.Set(module->functions[i].get(), SummarizeFunction(chunkModule->functions[i].get(), summaries.Digests()));
+    }
+    return chunkModule;
+}
+// the functions reachable through calls from the roots: the exports, the
+// start function, ref.func global initializers and everything placed in a
+// table. with an entry only that
+// export is a root, and the table contents become reachable once a
+// reachable function makes an indirect call
+std::vector<wasm::Function *> FindReachableFunctions(wasm::Module *module, const std::string &entry, FunctionSummaries &summaries)
+{
+    std::unordered_set<wasm::Function *> reachable;
+    std::vector<wasm::Function *> pending;
+    bool tableReached = false;
+
+    auto reach = [&](wasm::Name name)
+    {
+        wasm::Function *function = module->getFunctionOrNull(name);
+        if (function != nullptr && reachable.insert(function).second)
+            pending.push_back(function);
+    };
+    auto reachTable = [&]()
+    {
+        if (tableReached)
+            return;
+        tableReached = true;
+
+        for (std::unique_ptr<wasm::ElementSegment> &segment : module->elementSegments)
+            for (wasm::Expression *item : segment->data)
+                if (wasm::RefFunc *reference = item->dynCast<wasm::RefFunc>())
+                    reach(reference->func);
+    };
+
+    if (!entry.empty())
+    {
+        wasm::Export *entryExport = module->getExportOrNull(wasm::Name(entry));
+        if (entryExport == nullptr || entryExport->kind != wasm::ExternalKind::Function)
+        {
+            Report("no exported function named ", entry);
+            throw std::runtime_error("unknown entry");
+        }
+        reach(entryExport->value);
+    }
+    else
+    {
+        for (std::unique_ptr<wasm::Export> &moduleExport : module->exports)
+            if (moduleExport->kind == wasm::ExternalKind::Function)
+                reach(moduleExport->value);
+        if (module->start.is())
+            reach(module->start);
+        for (std::unique_ptr<wasm::Global> &global : module->globals)
+            if (global->init != nullptr)
+                if (wasm::RefFunc *reference = global->init->dynCast<wasm::RefFunc>())
+                    reach(reference->func);
+        reachTable();
+    }
+
+    while (!pending.empty())
+    {
+        wasm::Function *function = pending.back();
+        pending.pop_back();
+
+        const FunctionSummary &summary = summaries.Get(function);
+        for (wasm::Name callee : summary.callees)
+            reach(callee);
+        if (summary.callsIndirectly)
+            reachTable();
+    }
+
+    std::vector<wasm::Function *> functions;
+    for (std::unique_ptr<wasm::Function> &function : module->functions)
+        if (reachable.count(function.get()) != 0)
+            functions.push_back(function.get());
+
+    return functions;
+}
+// lays out the function table for the signatures the planned functions
+// call indirectly. element segments at constant offsets are resolved here
+// so the tables can be initialized statically
+TableLayout PlanWasm2cTable(wasm::Module *module, const std::vector<wasm::Function *> &functions, FunctionSummaries &summaries)
+{
+    TableLayout table;
+
+    for (wasm::Function *function : functions)
+    {
+        for (const wasm::Signature &signature : summaries.Get(function).indirectSignatures)
+            table.signatures.emplace(GetSignatureName(signature), signature);
+    }
+
+    if (table.signatures.empty())
+        return table;
+
+    if (!module->tables.empty())
+        table.size = module->tables[0]->initial.addr;
+
+    for (std::unique_ptr<wasm::ElementSegment> &segment : module->elementSegments)
+    {
+        // passive segments are only used by table.init
+        if (segment->offset == nullptr)
+            continue;
+
+        wasm::Const *offset = segment->offset->dynCast<wasm::Const>();
+        if (offset == nullptr)
+        {
+            table.constant = false;
+            continue;
+        }
+
+        size_t start = uint32_t(offset->value.geti32());
+        table.size = std::max(table.size, start + segment->data.size());
+        if (table.slots.size() < start + segment->data.size())
+            table.slots.resize(start + segment->data.size());
+
+        for (size_t i = 0; i < segment->data.size(); i++)
+        {
+            wasm::RefFunc *reference = segment->data[i]->dynCast<wasm::RefFunc>();
+            table.slots[start + i] = reference != nullptr ? module->getFunctionOrNull(reference->func) : nullptr;
+        }
+    }
+    table.slots.resize(table.size);
+
+    return table;
+}
+void PlanWasm2cFeatures(wasm::Module *module, EmitPlan &plan, FunctionSummaries &summaries)
+{
+    FeatureScanner scanner;
+
+    for (std::unique_ptr<wasm::Global> &global : module->globals)
+    {
+        if (global->type == wasm::Type::v128)
+            scanner.simd = true;
+    }
+
+    for (wasm::Function *function : plan.functions)
+    {
+        for (size_t i = 0; i < function->getNumLocals(); i++)
+        {
+            if (function->getLocalType(i) == wasm::Type::v128)
+                scanner.simd = true;
+        }
+        if (function->getResults() == wasm::Type::v128)
+            scanner.simd = true;
+
+        const FunctionSummary &summary = summaries.Get(function);
+        scanner.simd |= summary.simd;
+        scanner.bulkMemory |= summary.bulkMemory;
+        scanner.memoryInit |= summary.memoryInit;
+    }
+
+    plan.usesSimd = scanner.simd;
+    plan.usesBulkMemory = scanner.bulkMemory;
+    plan.usesMemoryInit = scanner.memoryInit;
+}
+// whether two functions with the same digest really are the same. streamed
+// bodies are never parsed at the same time, so for them the digest decides
+bool SameFunctionStructure(wasm::Function *left, wasm::Function *right)
+{
+    return left->getSig() == right->getSig() && left->vars == right->vars && wasm::ExpressionAnalyzer::equal(left->body, right->body);
+}
+// finds the planned functions emitting the same C as an earlier one but for
+// their name: the same digest, and the same functions in the table slots
+// they call directly
+void PlanWasm2cDuplicates(wasm::Module *module, EmitPlan &plan, FunctionSummaries &summaries)
+{
+    std::unordered_set<wasm::Function *> exported;
+    for (std::unique_ptr<wasm::Export> &moduleExport : module->exports)
+        if (moduleExport->kind == wasm::ExternalKind::Function)
+            exported.insert(module->getFunctionOrNull(moduleExport->value));
+    if (module->start.is())
+        exported.insert(module->getFunctionOrNull(module->start));
+
+    // a streamed skeleton holds no bodies to compare, so the digests are
+    // confirmed on the bytes of the code section instead
+    std::unordered_map<wasm::Function *, size_t> bodyIndices;
+    if (plan.stream != nullptr)
+    {
+        size_t firstBody = module->functions.size() - plan.stream->Bodies();
+        for (size_t i = firstBody; i < module->functions.size(); i++)
+            bodyIndices[module->functions[i].get()] = i - firstBody;
+    }
+    auto sameFunction = [&](wasm::Function *left, wasm::Function *right)
+    {
+        if (plan.stream == nullptr)
+            return SameFunctionStructure(left, right);
+        return left->getSig() == right->getSig() && plan.stream->SameBody(bodyIndices.at(left), bodyIndices.at(right));
+    };
+
+    std::unordered_map<uint64_t, std::vector<wasm::Function *>> canonicals;
+    for (wasm::Function *function : plan.functions)
+    {
+        if (function->body == nullptr)
+            continue;
+
+        const FunctionSummary &summary = summaries.Get(function);
+        StableHasher hasher;
+        hasher.Add(summary.digest);
+        if (plan.table.constant)
+        {
+            for (uint32_t slot : summary.constantSlots)
+                if (slot < plan.table.slots.size() && plan.table.slots[slot] != nullptr)
+                    hasher.AddName(plan.table.slots[slot]->name);
+        }
+
+        std::vector<wasm::Function *> &candidates = canonicals[hasher.Digest()];
+        wasm::Function *canonical = nullptr;
+        for (wasm::Function *candidate : candidates)
+        {
+            if (sameFunction(candidate, function))
+            {
+                canonical = candidate;
+                break;
+            }
+        }
+
+        if (canonical != nullptr)
+            plan.duplicates[function] = {canonical, exported.count(function) != 0};
+        else
+            candidates.push_back(function);
+    }
+}
+// reads a --profile file. every line is either
+//   function <name> <calls>
+//   branch <function name> <index> <times taken> <times not taken>
+// with the branches of a function numbered from 0 in the order the if and
+// br_if opcodes appear in its wasm code. blank lines and lines starting
+// with # are skipped
+std::unordered_map<std::string, FunctionProfile> ReadWasm2cProfile(const std::string &path)
+{
+    std::ifstream profileStream(path);
+    if (!profileStream.is_open())
+    {
+        Report("could not open profile ", path);
+        throw std::runtime_error("unable to open profile");
+    }
+
+    std::unordered_map<std::string, FunctionProfile> profile;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(profileStream, line); lineNumber++)
+    {
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind) || kind[0] == '#')
+            continue;
+
+        std::string name;
+        if (kind == "function")
+        {
+            uint64_t calls;
+            if (fields >> name >> calls)
+            {
+                profile[name].counted = true;
+                profile[name].calls += calls;
+                continue;
+            }
+        }
+        else if (kind == "branch")
+        {
+            size_t index;
+            uint64_t taken;
+            uint64_t notTaken;
+            if (fields >> name >> index >> taken >> notTaken)
+            {
+                std::vector<std::pair<uint64_t, uint64_t>> &branches = profile[name].branches;
+                if (index >= branches.size())
+                    branches.resize(index + 1);
+                branches[index].first += taken;
+                branches[index].second += notTaken;
+                continue;
+            }
+        }
+
+        Report("malformed profile line ", lineNumber, " in ", path);
+        throw std::runtime_error("malformed profile");
+    }
+
+    return profile;
+}
+// marks the functions that together take 90% of the profiled calls hot and
+// those the profile counts as never called cold, and moves the hot ones to the front hottest
+// first. a streamed module is emitted in module order, so its functions
+// are only marked
+void PlanWasm2cProfile(EmitPlan &plan)
+{
+    constexpr double hotFraction = 0.9;
+
+    std::vector<std::pair<uint64_t, wasm::Function *>> calls;
+    uint64_t totalCalls = 0;
+    for (wasm::Function *function : plan.functions)
+    {
+        if (function->body == nullptr)
+            continue;
+
+        const FunctionProfile *profile = plan.GetProfile(function);
+        uint64_t count = profile != nullptr ? profile->calls : 0;
+        calls.push_back({count, function});
+        totalCalls += count;
+    }
+    std::stable_sort(calls.begin(), calls.end(), [](const auto &left, const auto &right)
+                     { return left.first > right.first; });
+
+    std::vector<wasm::Function *> hot;
+    uint64_t hotCalls = 0;
+    for (auto [count, function] : calls)
+    {
+        if (count == 0)
+        {
+            // a function the profile does not mention is left alone
+            const FunctionProfile *profile = plan.GetProfile(function);
+            if (profile != nullptr && profile->counted)
+                plan.heat[function->name.str] = FunctionHeat::Cold;
+        }
+        else if (hotCalls < hotFraction * totalCalls)
+        {
+            plan.heat[function->name.str] = FunctionHeat::Hot;
+            hot.push_back(function);
+            hotCalls += count;
+        }
+    }
+
+    if (plan.stream != nullptr)
+        return;
+
+    std::vector<wasm::Function *> functions = hot;
+    for (wasm::Function *function : plan.functions)
+        if (plan.GetHeat(function) != FunctionHeat::Hot)
+            functions.push_back(function);
+    plan.functions = std::move(functions);
+}
+// picks the functions to emit as static inline: defined, at most
+// options.inlineBudget expressions, calling and referring to no other
+// function so they can never recurse, and neither exported nor the start
+// function since those need a symbol of their own. duplicates stay a
+// #define of their canonical function, which may be inlined itself
+void PlanWasm2cInlining(wasm::Module *module, EmitPlan &plan, const Wasm2cOptions &options, FunctionSummaries &summaries)
+{
+    std::unordered_set<std::string> exported;
+    for (std::unique_ptr<wasm::Export> &moduleExport : module->exports)
+        if (moduleExport->kind == wasm::ExternalKind::Function)
+            exported.insert(moduleExport->value.str);
+    if (module->start.is())
+        exported.insert(module->start.str);
+
+    for (wasm::Function *function : plan.functions)
+    {
+        if (function->body == nullptr || plan.duplicates.count(function) != 0 || exported.count(function->name.str) != 0)
+            continue;
+
+        const FunctionSummary &summary = summaries.Get(function);
+        if (summary.expressions <= options.inlineBudget && summary.callees.empty() && !summary.callsIndirectly)
+            plan.inlined.insert(function->name.str);
+    }
+
+    for (wasm::Function *function : plan.functions)
+    {
+        if (function->body == nullptr)
+            continue;
+
+        for (wasm::Name callee : summaries.Get(function).callees)
+            if (plan.inlined.count(callee.str) != 0)
+                plan.inlinedCallSites++;
+    }
+
+    if (!plan.inlined.empty())
+        Report("inlining ", plan.inlined.size(), " small functions at ", plan.inlinedCallSites, " call sites");
+}
+// finds the globals whose value never changes: immutable ones, and mutable
+// ones neither exported nor written by a planned function, since functions
+// that are not emitted never run. their value is a constant or an imported
+// global, an initializer reading another constant global takes its value
+void PlanWasm2cGlobals(wasm::Module *module, EmitPlan &plan, FunctionSummaries &summaries)
+{
+    std::unordered_set<std::string> written;
+    for (std::unique_ptr<wasm::Export> &moduleExport : module->exports)
+        if (moduleExport->kind == wasm::ExternalKind::Global)
+            written.insert(moduleExport->value.str);
+    for (wasm::Function *function : plan.functions)
+        if (function->body != nullptr)
+            for (wasm::Name global : summaries.Get(function).globalsSet)
+                written.insert(global.str);
+
+    for (std::unique_ptr<wasm::Global> &global : module->globals)
+    {
+        if (global->imported() || (global->mutable_ && written.count(global->name.str) != 0))
+            continue;
+
+        wasm::Expression *value = global->init;
+        if (wasm::GlobalGet *get = value->dynCast<wasm::GlobalGet>())
+        {
+            auto constant = plan.constantGlobals.find(get->name.str);
+            if (constant != plan.constantGlobals.end())
+                value = constant->second;
+            else if (wasm::Global *source = module->getGlobalOrNull(get->name); source == nullptr || !source->imported())
+                continue;
+        }
+        else if (!value->is<wasm::Const>())
+            continue;
+
+        plan.constantGlobals[global->name.str] = value;
+    }
+}
+EmitPlan PlanWasm2c(wasm::Module *module, const StreamedCodeSection *stream, const Wasm2cOptions &options, FunctionSummaries &summaries)
+{
+    EmitPlan plan;
+    plan.stream = stream;
+
+    if (options.keepUnreachable && options.entry.empty())
+    {
+        for (std::unique_ptr<wasm::Function> &function : module->functions)
+            plan.functions.push_back(function.get());
+    }
+    else
+    {
+        plan.functions = FindReachableFunctions(module, options.entry, summaries);
+        Report("emitting ", plan.functions.size(), " of ", module->functions.size(), " functions, ", module->functions.size() - plan.functions.size(), " unreachable");
+    }
+
+    plan.table = PlanWasm2cTable(module, plan.functions, summaries);
+    PlanWasm2cFeatures(module, plan, summaries);
+    PlanWasm2cGlobals(module, plan, summaries);
+    if (!options.keepDuplicates)
+        PlanWasm2cDuplicates(module, plan, summaries);
+    if (options.inlineBudget != 0)
+        PlanWasm2cInlining(module, plan, options, summaries);
+    if (!options.profileFile.empty())
+    {
+        plan.profile = ReadWasm2cProfile(options.profileFile);
+        // the passes rewrite the code the branches were counted on
+        if (options.optimizeLevel > 0 || options.shrinkLevel > 0 || !options.passes.empty())
+        {
+            Report("ignoring the branch counts of the profile, -O and --passes change the branches");
+            for (auto &[name, profile] : plan.profile)
+                profile.branches.clear();
+        }
+        PlanWasm2cProfile(plan);
+    }
+    if (plan.usesMemoryInit && options.dataMode == DataMode::None)
+        Report("memory.init and data.drop need the data segments, pass --data file or --data incbin");
+
+    return plan;
+}
+struct EmittedFunction
+{
+    uint64_t hash = 0;
+    CodeWriter body;
+    double seconds = 0;
+};
+// hands the planned functions of a streamed module to emit() a chunk at a
+// time, each chunk parsed right before and freed right after. the imports
+// and the duplicates need no body, so they are passed as planned
+void EmitStreamedWasm2cFunctions(wasm::Module *module, const EmitPlan &plan, const std::function<void(const std::vector<wasm::Function *> &)> &emit)
+{
+    std::unordered_map<wasm::Function *, size_t> positions;
+    for (size_t i = 0; i < module->functions.size(); i++)
+        positions[module->functions[i].get()] = i;
+    size_t firstBody = module->functions.size() - plan.stream->Bodies();
+
+    // the imports come first
+    size_t next = 0;
+    std::vector<wasm::Function *> functions;
+    while (next < plan.functions.size() && positions[plan.functions[next]] < firstBody)
+        functions.push_back(plan.functions[next++]);
+    emit(functions);
+
+    for (size_t chunk = 0; chunk < plan.stream->Chunks(); chunk++)
+    {
+        std::unique_ptr<wasm::Module> chunkModule = chunk == 0 ? std::move(plan.firstChunk) : nullptr;
+
+        // the functions of the chunk, and which of them need their body
+        functions.clear();
+        std::vector<size_t> parsed;
+        while (next < plan.functions.size() && positions[plan.functions[next]] < firstBody + plan.stream->ChunkEnd(chunk))
+        {
+            wasm::Function *function = plan.functions[next++];
+            if (plan.duplicates.count(function) == 0)
+                parsed.push_back(functions.size());
+            functions.push_back(function);
+        }
+        if (functions.empty())
+            continue;
+
+        if (!parsed.empty())
+        {
+            if (chunkModule == nullptr)
+                chunkModule = plan.stream->ParseChunk(chunk);
+            for (size_t index : parsed)
+                functions[index] = chunkModule->functions[positions[functions[index]]].get();
+        }
+        emit(functions);
+    }
+}
+// the C standing in for a duplicate function: nothing, as it is a #define of
+// the canonical one, or a call to the canonical function when exported
+CodeWriter GenerateWasm2cDuplicate(wasm::Function *function, const EmitPlan::Duplicate &duplicate)
+{
+    CodeWriter output;
+    if (!duplicate.exported)
+        return output;
+
+    WriteFunctionSignature(output, function);
+    output << "\n{\n";
+    output.Indent();
+    output.Indentation();
+    if (function->getResults() != wasm::Type::none)
+        output << "return ";
+    output << "func" << duplicate.canonical->name.str << "(";
+    for (size_t i = 0; i < function->getNumParams(); i++)
+    {
+        if (i != 0)
+            output << ", ";
+        output.Local(i);
+    }
+    output << ");\n";
+    output.Dedent();
+    output << "}\n\n";
+
+    return output;
+}
+// emits every function body and hands them to consume() in module order. a
+// streamed module is parsed one chunk at a time, right before the functions
+// planned in it are emitted, and freed once they are. duplicates need no
+// body, so they are emitted from the module the plan was made for
+void EmitWasm2cFunctions(wasm::Module *module, const EmitPlan &plan, const Wasm2cOptions &options, FunctionCache *cache, DecompileStats *stats, const std::function<void(EmittedFunction &)> &consume)
+{
+    // the size of every canonical body and how many duplicates it has, to
+    // tell how much the duplicates save. a profile can put a duplicate
+    // before its canonical function
+    std::unordered_map<wasm::Function *, size_t> canonicalSizes;
+    std::unordered_map<wasm::Function *, size_t> duplicatesOf;
+    size_t consumed = 0;
+    size_t duplicateCount = 0;
+    int64_t savedBytes = 0;
+
+    auto produce = [&](wasm::Function *function)
+    {
+        EmittedFunction emitted;
+
+        auto duplicate = plan.duplicates.find(function);
+        if (duplicate != plan.duplicates.end())
+        {
+            emitted.body = GenerateWasm2cDuplicate(function, duplicate->second);
+            return emitted;
+        }
+
+        const FunctionProfile *profile = plan.GetProfile(function);
+        FunctionHeat heat = plan.GetHeat(function);
+        bool inlined = plan.IsInlined(function);
+        if (cache != nullptr)
+        {
+            emitted.hash = HashFunction(function, plan.table, plan.constantGlobals, profile, heat, inlined);
+            if (cache->Lookup(emitted.hash, emitted.body))
+                return emitted;
+        }
+
+        emitted.body = GenerateWasm2cFunction(function, options, plan.table, plan.constantGlobals, profile, heat, inlined);
+        return emitted;
+    };
+
+    auto emit = [&](const std::vector<wasm::Function *> &functions)
+    {
+        OrderedParallelFor<EmittedFunction>(
+            functions.size(), options.jobs, [&](size_t index)
+            {
+                if (stats == nullptr)
+                    return produce(functions[index]);
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                EmittedFunction emitted = produce(functions[index]);
+                emitted.seconds = SecondsSince(start);
+                return emitted;
+            },
+            [&](EmittedFunction &emitted)
+            {
+                wasm::Function *function = plan.functions[consumed++];
+                if (stats != nullptr)
+                    stats->functions.push_back({function->name.str, emitted.seconds, emitted.body.Size(), plan.IsInlined(function)});
+
+                auto duplicate = plan.duplicates.find(function);
+                if (duplicate == plan.duplicates.end())
+                {
+                    if (!plan.duplicates.empty())
+                        canonicalSizes[function] = emitted.body.Size();
+                    if (cache != nullptr)
+                        cache->Store(emitted.hash, emitted.body);
+                }
+                else
+                {
+                    // the body would have been the canonical one under another name
+                    wasm::Function *canonical = duplicate->second.canonical;
+                    duplicateCount++;
+                    duplicatesOf[canonical]++;
+                    savedBytes += int64_t(std::strlen(function->name.str)) - int64_t(std::strlen(canonical->name.str) + emitted.body.Size());
+                }
+                consume(emitted);
+            });
+    };
+
+    if (plan.stream == nullptr)
+        emit(plan.functions);
+    else
+        EmitStreamedWasm2cFunctions(module, plan, emit);
+
+    for (auto [canonical, count] : duplicatesOf)
+        savedBytes += int64_t(canonicalSizes[canonical] * count);
+    if (duplicateCount != 0)
+        Report("deduplicated ", duplicateCount, " functions, saving ", savedBytes, " bytes of C");
+}
+void GenerateWasm2cFunctionBodies(wasm::Module *module, const EmitPlan &plan, OutputSink &sink, const Wasm2cOptions &options, FunctionCache *cache, DecompileStats *stats)
+{
+    // written in module order so the output does not depend on the job count
+    EmitWasm2cFunctions(module, plan, options, cache, stats, [&](EmittedFunction &emitted)
+                        { emitted.body.WriteTo(sink); });
+}
+void GenerateWasm2cFunctionDeclarations(const EmitPlan &plan, OutputSink &sink)
+{
+    CodeWriter output;
+    for (wasm::Function *function : plan.functions)
+    {
+        auto duplicate = plan.duplicates.find(function);
+        if (duplicate != plan.duplicates.end() && !duplicate->second.exported)
+        {
+            output << "#define func" << function->name.str << " func" << duplicate->second.canonical->name.str << "\n";
+            continue;
+        }
+
+        if (plan.IsInlined(function))
+            output << "static inline ";
+        WriteFunctionSignature(output, function);
+
+        output << ";\n";
+    }
+
+    output.WriteTo(sink);
+}
+// memory.copy and memory.fill call into libc, whose implementations are
+// vectorized. WASM_RANGE checks a whole range up front where the memory mode
+// checks accesses
+void WriteBulkMemoryHelpers(CodeWriter &output)
+{
+    output << "#include <stdlib.h>\n"
+              "#include <string.h>\n"
+              "\n"
+              "static inline void wasm_memory_copy(uint32_t destination, uint32_t source, uint32_t size)\n"
+              "{\n"
+              "    memmove(u8 + WASM_RANGE(destination, size), u8 + WASM_RANGE(source, size), size);\n"
+              "}\n"
+              "static inline void wasm_memory_fill(uint32_t destination, uint32_t value, uint32_t size)\n"
+              "{\n"
+              "    memset(u8 + WASM_RANGE(destination, size), (int)(uint8_t)value, size);\n"
+              "}\n"
+              "\n";
+}
+// loads and stores copy through memcpy rather than dereferencing a cast
+// pointer, so they neither break strict aliasing nor assume alignment, and
+// compilers still turn each of them into a single move
+void WriteMemoryAccessHelpers(CodeWriter &output)
+{
+    static const char *const loads[][2] = {{"uint8_t", "u8"}, {"int8_t", "i8"}, {"uint16_t", "u16"}, {"int16_t", "i16"}, {"uint32_t", "u32"}, {"int32_t", "i32"}, {"uint64_t", "u64"}, {"int64_t", "i64"}, {"float", "f32"}, {"double", "f64"}};
+    static const char *const stores[][2] = {{"uint8_t", "u8"}, {"uint16_t", "u16"}, {"uint32_t", "u32"}, {"uint64_t", "u64"}, {"float", "f32"}, {"double", "f64"}};
+
+    output << "#include <string.h>\n"
+              "\n"
+              "// alignment hints may be wrong in valid wasm, define WASM2C_TRUST_ALIGNMENT\n"
+              "// when they are known to hold\n"
+              "#ifdef WASM2C_TRUST_ALIGNMENT\n"
+              "#define WASM_ALIGNED(address, alignment) __builtin_assume_aligned((address), (alignment))\n"
+              "#else\n"
+              "#define WASM_ALIGNED(address, alignment) (address)\n"
+              "#endif\n";
+    for (const auto &[type, name] : loads)
+        output << "static inline " << type << " wasm_load_" << name << "(const uint8_t *address) { " << type << " value; memcpy(&value, address, sizeof(value)); return value; }\n";
+    for (const auto &[type, name] : stores)
+        output << "static inline void wasm_store_" << name << "(uint8_t *address, " << type << " value) { memcpy(address, &value, sizeof(value)); }\n";
+    output << "\n";
+}
+// the linear memory pointer, the load and store helpers and, for the runtime
+// memory modes, the code reserving and growing linear memory. declarations go
+// into a header shared by shards, definitions into exactly one translation
+// unit
+void GenerateWasm2cMemory(wasm::Module *module, const EmitPlan &plan, OutputSink &sink, const Wasm2cOptions &options, bool declarations, bool definitions)
+{
+    CodeWriter output;
+
+    if (options.memoryMode == MemoryMode::None)
+    {
+        if (!definitions)
+            output << "extern uint8_t *u8;\n";
+        else
+            output << "uint8_t *u8 = (uint8_t *)0;\n";
+        output << "\n";
+        if (declarations)
+            WriteMemoryAccessHelpers(output);
+
+        if (declarations && plan.usesBulkMemory)
+        {
+            output << "#define WASM_RANGE(pointer, size) ((uint32_t)(pointer))\n";
+            WriteBulkMemoryHelpers(output);
+        }
+
+        output.WriteTo(sink);
+        return;
+    }
+
+    uint64_t initialPages = module->memory.exists ? module->memory.initial.addr : 0;
+    uint64_t maximumPages = module->memory.exists && module->memory.hasMax() ? std::min<uint64_t>(module->memory.max.addr, 1 << 16) : 1 << 16;
+
+    // the smallest power of two covering the maximum memory
+    uint64_t addressMask = 0xffff;
+    while (addressMask + 1 < maximumPages << 16)
+        addressMask = addressMask << 1 | 1;
+
+    if (declarations)
+    {
+        output << "#include <stdlib.h>\n"
+                  "#include <sys/mman.h>\n"
+                  "\n"
+                  "#define WASM_PAGE_SIZE 65536\n";
+        output << "#define WASM_INITIAL_PAGES " << initialPages << "u\n";
+        output << "#define WASM_MAXIMUM_PAGES " << maximumPages << "u\n";
+
+        switch (options.memoryMode)
+        {
+        case MemoryMode::Guard:
+            output << "// out of bounds accesses land in the reserved but inaccessible part of the region\n"
+                      "#define WASM_ADDRESS(pointer, offset, size) ((uint64_t)(uint32_t)(pointer) + (offset))\n";
+            break;
+        case MemoryMode::Bounds:
+            output << "#define WASM_ADDRESS(pointer, offset, size) wasm_bounds_check((uint64_t)(uint32_t)(pointer) + (offset), (size))\n";
+            break;
+        case MemoryMode::Mask:
+            output << "// out of bounds accesses wrap around inside the region instead of trapping\n";
+            output << "#define WASM_ADDRESS_MASK " << addressMask << "ull\n";
+            output << "#define WASM_ADDRESS(pointer, offset, size) (((uint64_t)(uint32_t)(pointer) + (offset)) & WASM_ADDRESS_MASK)\n";
+            break;
+        case MemoryMode::None:
+            break;
+        }
+
+        output << "#define MEMORY_SIZE ((int32_t)wasm_memory_pages)\n"
+                  "#define MEMORY_GROW(delta) wasm_memory_grow((uint32_t)(delta))\n"
+                  "\n";
+
+        if (!definitions)
+            output << "extern uint8_t *u8;\n"
+                      "extern uint32_t wasm_memory_pages;\n";
+        else
+            output << "uint8_t *u8;\n"
+                      "uint32_t wasm_memory_pages;\n";
+        output << "\n";
+        WriteMemoryAccessHelpers(output);
+
+        // a range cannot wrap around like a single masked access, so the
+        // bulk memory instructions are bounds checked in the mask mode too
+        if (options.memoryMode == MemoryMode::Bounds || (options.memoryMode == MemoryMode::Mask && plan.usesBulkMemory))
+            output << "static inline uint64_t wasm_bounds_check(uint64_t address, uint64_t size)\n"
+                      "{\n"
+                      "    if (__builtin_expect(address + size > (uint64_t)wasm_memory_pages * WASM_PAGE_SIZE, 0))\n"
+                      "        abort();\n"
+                      "    return address;\n"
+                      "}\n";
+        if (plan.usesBulkMemory)
+        {
+            if (options.memoryMode == MemoryMode::Guard)
+                output << "#define WASM_RANGE(pointer, size) ((uint64_t)(uint32_t)(pointer))\n";
+            else
+                output << "#define WASM_RANGE(pointer, size) wasm_bounds_check((uint32_t)(pointer), (size))\n";
+            WriteBulkMemoryHelpers(output);
+        }
+
+        output << "int32_t wasm_memory_grow(uint32_t delta);\n"
+                  "// reserves linear memory, call once before any other function\n"
+                  "void wasm2c_init_memory(void);\n"
+                  "\n";
+    }
+
+    if (definitions)
+    {
+        if (!declarations)
+            output << "uint8_t *u8;\n"
+                      "uint32_t wasm_memory_pages;\n"
+                      "\n";
+
+        switch (options.memoryMode)
+        {
+        case MemoryMode::Guard:
+            // any 32 bit address plus 32 bit offset stays inside the region
+            output << "#define WASM_RESERVED_SIZE ((8ull << 30) + WASM_PAGE_SIZE)\n";
+            break;
+        case MemoryMode::Bounds:
+            output << "#define WASM_RESERVED_SIZE ((uint64_t)WASM_MAXIMUM_PAGES * WASM_PAGE_SIZE)\n";
+            break;
+        case MemoryMode::Mask:
+            // one extra page for accesses starting just below the mask
+            output << "#define WASM_RESERVED_SIZE (WASM_ADDRESS_MASK + 1 + WASM_PAGE_SIZE)\n";
+            break;
+        case MemoryMode::None:
+            break;
+        }
+
+        output << "\n"
+                  "int32_t wasm_memory_grow(uint32_t delta)\n"
+                  "{\n"
+                  "    uint32_t previousPages = wasm_memory_pages;\n"
+                  "    if (delta > WASM_MAXIMUM_PAGES - previousPages)\n"
+                  "        return -1;\n";
+        if (options.memoryMode != MemoryMode::Mask)
+            output << "    if (delta != 0 && mprotect(u8 + (uint64_t)previousPages * WASM_PAGE_SIZE, (uint64_t)delta * WASM_PAGE_SIZE, PROT_READ | PROT_WRITE) != 0)\n"
+                      "        return -1;\n";
+        output << "    wasm_memory_pages = previousPages + delta;\n"
+                  "    return (int32_t)previousPages;\n"
+                  "}\n"
+                  "void wasm2c_init_memory(void)\n"
+                  "{\n";
+        // the masked region is accessible up front, the others only grow
+        // into pages that memory.grow made accessible
+        output << "    void *base = mmap(NULL, WASM_RESERVED_SIZE, " << (options.memoryMode == MemoryMode::Mask ? "PROT_READ | PROT_WRITE" : "PROT_NONE") << ", MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);\n";
+        output << "    if (base == MAP_FAILED)\n"
+                  "        abort();\n"
+                  "\n";
+        output << "    u8 = (uint8_t *)base;\n"
+                  "\n"
+                  "    wasm_memory_pages = 0;\n"
+                  "    if (wasm_memory_grow(WASM_INITIAL_PAGES) < 0)\n"
+                  "        abort();\n"
+                  "}\n"
+                  "\n";
+    }
+
+    output.WriteTo(sink);
+}
+// the typed function tables and the wasm_call_indirect_<signature>
+// dispatchers. a dispatcher checks the index against its signature's table,
+// where slots holding a function of another signature are null. when a
+// constant table holds only a few functions of a signature the dispatcher
+// is a switch over them instead, so the C compiler can inline the calls
+void GenerateWasm2cTable(wasm::Module *module, const EmitPlan &plan, OutputSink &sink, bool declarations, bool definitions)
+{
+    constexpr size_t maximumSwitchCases = 8;
+
+    const TableLayout &table = plan.table;
+    if (table.signatures.empty())
+        return;
+
+    // the slots holding a function of each signature, for the switches
+    std::map<std::string, std::vector<size_t>> signatureSlots;
+    for (size_t i = 0; i < table.slots.size(); i++)
+        if (table.slots[i] != nullptr)
+            signatureSlots[GetSignatureName(table.slots[i]->getSig())].push_back(i);
+
+    auto usesSwitch = [&](const std::string &name)
+    {
+        return table.constant && signatureSlots[name].size() <= maximumSwitchCases;
+    };
+
+    CodeWriter output;
+
+    if (declarations)
+    {
+        output << "\n"
+                  "#include <stdlib.h>\n"
+                  "\n";
+        output << "#define WASM_TABLE_SIZE " << table.size << "u\n";
+
+        for (auto &[name, signature] : table.signatures)
+        {
+            wasm::Type results = signature.results;
+            output << "typedef " << GetStringFromWasmType(results) << " (*wasm_function_" << name << ")(";
+            size_t index = 0;
+            for (wasm::Type type : signature.params)
+                output << (index++ != 0 ? ", " : "") << GetStringFromWasmType(type);
+            output << ");\n";
+
+            if (!usesSwitch(name))
+                output << "extern " << (table.constant ? "const " : "") << "wasm_function_" << name << " wasm_table_" << name << "[WASM_TABLE_SIZE];\n";
+        }
+        output << "// fills the function tables, call once before any other function\n"
+                  "void wasm2c_init_table(void);\n"
+                  "\n";
+
+        for (auto &[name, signature] : table.signatures)
+        {
+            wasm::Type results = signature.results;
+            bool returnsValue = results != wasm::Type::none;
+
+            output << "static inline " << GetStringFromWasmType(results) << " wasm_call_indirect_" << name << "(uint32_t index";
+            size_t parameterCount = 0;
+            for (wasm::Type type : signature.params)
+            {
+                output << ", " << GetStringFromWasmType(type) << ' ';
+                output.Local(parameterCount++);
+            }
+            output << ")\n"
+                      "{\n";
+
+            auto writeArguments = [&]()
+            {
+                output << "(";
+                for (size_t i = 0; i < parameterCount; i++)
+                {
+                    if (i != 0)
+                        output << ", ";
+                    output.Local(i);
+                }
+                output << ")";
+            };
+
+            if (usesSwitch(name))
+            {
+                output << "    switch (index)\n"
+                          "    {\n";
+                for (size_t slot : signatureSlots[name])
+                {
+                    output << "    case " << slot << ":\n"
+                           << "        " << (returnsValue ? "return " : "") << "func" << table.slots[slot]->name.str;
+                    writeArguments();
+                    output << ";\n";
+                    if (!returnsValue)
+                        output << "        return;\n";
+                }
+                output << "    }\n"
+                          "    abort();\n";
+            }
+            else
+            {
+                output << "    if (index >= WASM_TABLE_SIZE || wasm_table_" << name << "[index] == NULL)\n"
+                       << "        abort();\n"
+                       << "    " << (returnsValue ? "return " : "") << "wasm_table_" << name << "[index]";
+                writeArguments();
+                output << ";\n";
+            }
+            output << "}\n";
+        }
+        output << "\n";
+    }
+
+    if (definitions)
+    {
+        if (table.constant)
+        {
+            for (auto &[name, signature] : table.signatures)
+            {
+                if (usesSwitch(name))
+                    continue;
+
+                output << "const wasm_function_" << name << " wasm_table_" << name << "[WASM_TABLE_SIZE] = {";
+                size_t index = 0;
+                for (size_t slot : signatureSlots[name])
+                    output << (index++ != 0 ? ", " : "") << "[" << slot << "] = func" << table.slots[slot]->name.str;
+                output << "};\n";
+            }
+            output << "void wasm2c_init_table(void)\n"
+                      "{\n"
+                      "}\n"
+                      "\n";
+        }
+        else
+        {
+            for (auto &[name, signature] : table.signatures)
+                output << "wasm_function_" << name << " wasm_table_" << name << "[WASM_TABLE_SIZE];\n";
+
+            EmitterContext context;
+            context.expressionDepth = 1;
+            output << "void wasm2c_init_table(void)\n"
+                      "{\n"
+                      "    uint32_t offset;\n";
+            for (std::unique_ptr<wasm::ElementSegment> &segment : module->elementSegments)
+            {
+                if (segment->offset == nullptr)
+                    continue;
+
+                output << "    offset = (uint32_t)(";
+                GetWasm2cExperssion(context, output, segment->offset);
+                output << ");\n"
+                       << "    if (offset > WASM_TABLE_SIZE || WASM_TABLE_SIZE - offset < " << segment->data.size() << "u)\n"
+                       << "        abort();\n";
+
+                for (size_t i = 0; i < segment->data.size(); i++)
+                {
+                    wasm::RefFunc *reference = segment->data[i]->dynCast<wasm::RefFunc>();
+                    wasm::Function *function = reference != nullptr ? module->getFunctionOrNull(reference->func) : nullptr;
+                    std::string name = function != nullptr ? GetSignatureName(function->getSig()) : "";
+
+                    // a slot overwritten by a later segment loses its old function
+                    for (auto &[tableName, signature] : table.signatures)
+                    {
+                        output << "    wasm_table_" << tableName << "[offset + " << i << "] = ";
+                        if (tableName == name)
+                            output << "func" << function->name.str << ";\n";
+                        else
+                            output << "NULL;\n";
+                    }
+                }
+            }
+            output << "}\n"
+                      "\n";
+        }
+    }
+
+    output.WriteTo(sink);
+}
+// a stretch of linear memory initialized from consecutive bytes of the data
+// file. active segments that lie close together share one run
+struct DataRun
+{
+    uint64_t address = 0;
+    std::vector<char> bytes;
+    uint64_t fileOffset = 0;
+};
+// writes the data segments to plan.dataFile and the code placing them in
+// linear memory. active segments at constant addresses are merged into runs
+// stored at file offsets congruent to their address modulo the wasm page
+// size, so a run inside the initial memory is mapped straight into linear
+// memory instead of being copied. passive segments stay in the mapped file
+// for memory.init
+void GenerateWasm2cData(wasm::Module *module, const EmitPlan &plan, OutputSink &sink, const Wasm2cOptions &options, bool declarations, bool definitions)
+{
+    constexpr uint64_t mapAlignment = 65536;
+
+    if (options.dataMode == DataMode::None)
+        return;
+
+    size_t segmentCount = module->dataSegments.size();
+    std::string dataFileName = std::filesystem::path(plan.dataFile).filename().string();
+
+    CodeWriter output;
+
+    if (declarations)
+    {
+        output << "#define WASM_DATA_SEGMENT_COUNT " << segmentCount << "u\n"
+               << "\n";
+
+        if (!definitions || plan.usesMemoryInit)
+            output << "extern const uint8_t *wasm_data;\n"
+                      "extern const uint64_t wasm_data_segment_offsets[];\n"
+                      "extern uint32_t wasm_data_segment_sizes[];\n";
+        // dropped and active segments have size 0, so memory.init on them
+        // traps unless it copies nothing
+        if (plan.usesMemoryInit)
+            output << "static inline void wasm_memory_init(uint32_t destination, uint32_t offset, uint32_t size, uint32_t segment)\n"
+                      "{\n"
+                      "    if ((uint64_t)offset + size > wasm_data_segment_sizes[segment])\n"
+                      "        abort();\n"
+                      "    memcpy(u8 + WASM_RANGE(destination, size), wasm_data + wasm_data_segment_offsets[segment] + offset, size);\n"
+                      "}\n";
+
+        if (options.dataMode == DataMode::File)
+            output << "// maps " << dataFileName << " and places the active data segments in linear memory.\n"
+                   << "// call after wasm2c_init_memory, returns 0 or -1 if the file could not be mapped\n"
+                   << "int wasm2c_init_data(const char *path);\n";
+        else
+            output << "// places the active data segments in linear memory, call after wasm2c_init_memory\n"
+                      "void wasm2c_init_data(void);\n";
+        output << "\n";
+    }
+
+    if (!definitions)
+    {
+        output.WriteTo(sink);
+        return;
+    }
+
+    // runs of the active segments with constant addresses, by address
+    std::vector<std::pair<uint64_t, size_t>> constantSegments;
+    std::vector<size_t> placedSegments;
+    for (size_t i = 0; i < segmentCount; i++)
+    {
+        wasm::DataSegment *segment = module->dataSegments[i].get();
+        if (segment->isPassive || segment->data.empty())
+            continue;
+
+        wasm::Const *offset = segment->offset->dynCast<wasm::Const>();
+        if (offset != nullptr)
+            constantSegments.push_back({uint32_t(offset->value.geti32()), i});
+        else
+            placedSegments.push_back(i);
+    }
+    std::stable_sort(constantSegments.begin(), constantSegments.end());
+
+    std::vector<DataRun> runs;
+    std::vector<size_t> segmentRuns(segmentCount);
+    for (const auto &[address, index] : constantSegments)
+    {
+        uint64_t end = address + module->dataSegments[index]->data.size();
+
+        // a run maps whole pages, so segments sharing or touching a page join it
+        if (runs.empty() || address > (runs.back().address + runs.back().bytes.size() + mapAlignment - 1) / mapAlignment * mapAlignment + mapAlignment)
+        {
+            runs.emplace_back();
+            runs.back().address = address;
+        }
+
+        DataRun &run = runs.back();
+        if (end > run.address + run.bytes.size())
+            run.bytes.resize(end - run.address);
+        segmentRuns[index] = runs.size() - 1;
+    }
+
+    // later segments overwrite earlier ones, so they are copied in module order
+    for (size_t i = 0; i < segmentCount; i++)
+    {
+        wasm::DataSegment *segment = module->dataSegments[i].get();
+        if (segment->isPassive || segment->data.empty())
+            continue;
+
+        wasm::Const *offset = segment->offset->dynCast<wasm::Const>();
+        if (offset == nullptr)
+            continue;
+
+        DataRun &run = runs[segmentRuns[i]];
+        uint64_t address = uint32_t(offset->value.geti32());
+        std::copy(segment->data.begin(), segment->data.end(), run.bytes.begin() + (address - run.address));
+    }
+
+    std::vector<uint64_t> segmentOffsets(segmentCount, 0);
+    std::vector<uint64_t> segmentSizes(segmentCount, 0);
+    {
+        std::optional<FileOutputSink> dataFile;
+        OutputSink *file = plan.dataSink;
+        if (file == nullptr)
+            file = &dataFile.emplace(plan.dataFile);
+        uint64_t fileSize = 0;
+
+        auto pad = [&](uint64_t size)
+        {
+            static const char zeros[4096] = {};
+            while (fileSize < size)
+            {
+                uint64_t count = std::min<uint64_t>(size - fileSize, sizeof(zeros));
+                file->Write(std::string_view(zeros, count));
+                fileSize += count;
+            }
+        };
+
+        for (DataRun &run : runs)
+        {
+            pad((fileSize + mapAlignment - 1) / mapAlignment * mapAlignment + run.address % mapAlignment);
+            run.fileOffset = fileSize;
+            file->Write(std::string_view(run.bytes.data(), run.bytes.size()));
+            fileSize += run.bytes.size();
+        }
+        // the last mapped page has to lie entirely inside the file
+        pad((fileSize + mapAlignment - 1) / mapAlignment * mapAlignment);
+
+        for (size_t i = 0; i < segmentCount; i++)
+        {
+            wasm::DataSegment *segment = module->dataSegments[i].get();
+            bool placed = std::find(placedSegments.begin(), placedSegments.end(), i) != placedSegments.end();
+            if (!segment->isPassive && !placed)
+                continue;
+
+            segmentOffsets[i] = fileSize;
+            if (segment->isPassive)
+                segmentSizes[i] = segment->data.size();
+            file->Write(std::string_view(segment->data.data(), segment->data.size()));
+            fileSize += segment->data.size();
+        }
+    }
+
+    output << "#include <string.h>\n";
+    if (options.dataMode == DataMode::File)
+        output << "#include <fcntl.h>\n"
+                  "#include <sys/mman.h>\n"
+                  "#include <sys/stat.h>\n"
+                  "#include <unistd.h>\n";
+    output << "\n";
+
+    // active segments count as dropped for memory.init
+    output << "const uint8_t *wasm_data;\n"
+              "const uint64_t wasm_data_segment_offsets[] = {";
+    for (size_t i = 0; i < segmentCount; i++)
+        output << (i != 0 ? ", " : "") << segmentOffsets[i] << "ull";
+    if (segmentCount == 0)
+        output << "0";
+    output << "};\n"
+              "uint32_t wasm_data_segment_sizes[] = {";
+    for (size_t i = 0; i < segmentCount; i++)
+        output << (i != 0 ? ", " : "") << segmentSizes[i] << "u";
+    if (segmentCount == 0)
+        output << "0";
+    output << "};\n"
+              "\n";
+
+    uint64_t initialSize = module->memory.exists ? uint64_t(module->memory.initial.addr) * 65536 : 0;
+
+    if (options.dataMode == DataMode::Incbin)
+    {
+        // the assembler looks the file up relative to its working directory
+        // and -I paths
+        output << "__asm__(\".section .rodata\\n\"\n"
+               << "        \".balign 16\\n\"\n"
+               << "        \"wasm_data_blob:\\n\"\n"
+               << "        \".incbin \\\"" << dataFileName << "\\\"\\n\"\n"
+               << "        \".previous\\n\");\n"
+               << "extern const uint8_t wasm_data_blob[] __asm__(\"wasm_data_blob\");\n"
+               << "\n"
+               << "void wasm2c_init_data(void)\n"
+               << "{\n"
+               << "    wasm_data = wasm_data_blob;\n";
+    }
+    else
+    {
+        output << "int wasm2c_init_data(const char *path)\n"
+                  "{\n"
+                  "    int file = open(path, O_RDONLY);\n"
+                  "    if (file < 0)\n"
+                  "        return -1;\n"
+                  "    struct stat status;\n"
+                  "    if (fstat(file, &status) != 0)\n"
+                  "    {\n"
+                  "        close(file);\n"
+                  "        return -1;\n"
+                  "    }\n"
+                  "    if (status.st_size != 0)\n"
+                  "    {\n"
+                  "        void *data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);\n"
+                  "        if (data == MAP_FAILED)\n"
+                  "        {\n"
+                  "            close(file);\n"
+                  "            return -1;\n"
+                  "        }\n"
+                  "        wasm_data = (const uint8_t *)data;\n"
+                  "    }\n";
+    }
+
+    for (const DataRun &run : runs)
+    {
+        uint64_t pageStart = run.address / mapAlignment * mapAlignment;
+        uint64_t pageEnd = (run.address + run.bytes.size() + mapAlignment - 1) / mapAlignment * mapAlignment;
+
+        // linear memory is still zero, as is the file around the run, so the
+        // pages are replaced by private mappings of the file. pages outside
+        // the initial memory must stay inaccessible and are copied instead
+        if (options.dataMode == DataMode::File && options.memoryMode != MemoryMode::None && pageEnd <= initialSize)
+        {
+            output << "    if (mmap(u8 + " << pageStart << "ull, " << pageEnd - pageStart << "ull, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file, " << run.fileOffset - run.address % mapAlignment << ") == MAP_FAILED)\n"
+                   << "    {\n"
+                   << "        close(file);\n"
+                   << "        return -1;\n"
+                   << "    }\n";
+        }
+        else
+        {
+            output << "    memcpy(u8 + " << run.address << "ull, wasm_data + " << run.fileOffset << "ull, " << run.bytes.size() << ");\n";
+        }
+    }
+
+    EmitterContext context;
+    context.expressionDepth = 1;
+    context.memoryMode = options.memoryMode;
+    for (size_t index : placedSegments)
+    {
+        wasm::DataSegment *segment = module->dataSegments[index].get();
+
+        output << "    memcpy(u8 + (uint32_t)(";
+        GetWasm2cExperssion(context, output, segment->offset);
+        output << "), wasm_data + " << segmentOffsets[index] << "ull, " << segment->data.size() << ");\n";
+    }
+
+    if (options.dataMode == DataMode::File)
+        output << "    close(file);\n"
+                  "    return 0;\n";
+    output << "}\n"
+              "\n";
+
+    output.WriteTo(sink);
+}
+// imported globals are declared extern for the embedder to define. the
+// constant globals that are not exported are only read through their value,
+// so they are declared along with the rest: static const, marked unused as
+// reads no longer name it, or a #define when the value is not a C constant
+// expression. the other globals are variables,
+// those initialized from another global or with a vector are assigned in
+// wasm2c_init_globals(). declarations go into a header shared by shards,
+// definitions into exactly one translation unit
+void GenerateWasm2cGlobals(wasm::Module *module, const EmitPlan &plan, OutputSink &sink, bool declarations, bool definitions)
+{
+    std::unordered_set<std::string> exported;
+    for (std::unique_ptr<wasm::Export> &moduleExport : module->exports)
+        if (moduleExport->kind == wasm::ExternalKind::Global)
+            exported.insert(moduleExport->value.str);
+
+    EmitterContext context;
+    context.expressionDepth = 1;
+    context.constantGlobals = &plan.constantGlobals;
+    CodeWriter output;
+    std::vector<wasm::Global *> initialized;
+    for (std::unique_ptr<wasm::Global> &global : module->globals)
+    {
+        std::string type = GetStringFromWasmType(global->type);
+        if (global->imported())
+        {
+            if (declarations)
+                output << "extern " << type << " " << global->name.str << ";\n";
+            continue;
+        }
+
+        auto constant = plan.constantGlobals.find(global->name.str);
+        if (constant != plan.constantGlobals.end() && exported.count(global->name.str) == 0)
+        {
+            if (!declarations)
+                continue;
+
+            bool constantExpression = constant->second->is<wasm::Const>() && global->type != wasm::Type::v128;
+            if (constantExpression)
+                output << "static const " << type << " " << global->name.str << " __attribute__((unused)) = ";
+            else
+                output << "#define " << global->name.str << " ";
+            GetWasm2cExperssion(context, output, constant->second);
+            output << (constantExpression ? ";\n" : "\n");
+            continue;
+        }
+
+        wasm::Const *literal = global->init->dynCast<wasm::Const>();
+        if (literal == nullptr || global->type == wasm::Type::v128)
+            initialized.push_back(global.get());
+
+        if (declarations && !definitions)
+            output << "extern " << type << " " << global->name.str << ";\n";
+        if (definitions)
+        {
+            output << type << " " << global->name.str;
+            if (literal != nullptr && global->type != wasm::Type::v128)
+            {
+                output << " = ";
+                WriteWasm2cLiteral(output, literal->value);
+            }
+            output << ";\n";
+        }
+    }
+
+    if (!initialized.empty() && declarations)
+        output << "// sets the globals initialized from another global or with a vector,\n"
+                  "// call once before any other function\n"
+                  "void wasm2c_init_globals(void);\n";
+    if (!initialized.empty() && definitions)
+    {
+        output << "void wasm2c_init_globals(void)\n"
+                  "{\n";
+        for (wasm::Global *global : initialized)
+        {
+            output << "    " << global->name.str << " = ";
+            GetWasm2cExperssion(context, output, global->init);
+            output << ";\n";
+        }
+        output << "}\n";
+    }
+
+    output << "\n";
+    output.WriteTo(sink);
+}
+void GenerateWasm2c(wasm::Module *module, const EmitPlan &plan, OutputSink &sink, const Wasm2cOptions &options, FunctionCache *cache = nullptr, DecompileStats *stats = nullptr)
+{
+    sink.Write("#include <stdint.h>\n");
+    if (plan.usesSimd)
+        sink.Write("#include \"wasm2c_simd.h\"\n");
+    sink.Write("\n");
+
+    GenerateWasm2cGlobals(module, plan, sink, true, true);
+    GenerateWasm2cMemory(module, plan, sink, options, true, true);
+    GenerateWasm2cData(module, plan, sink, options, true, true);
+    GenerateWasm2cFunctionDeclarations(plan, sink);
+    GenerateWasm2cTable(module, plan, sink, true, true);
+    GenerateWasm2cFunctionBodies(module, plan, sink, options, cache, stats);
+}
+// splits the function bodies over up to options.shards translation units.
+// each shard gets roughly the same amount of C: bodies are placed largest
+// first onto the least loaded shard, and the shard count is lowered so no
+// shard ends up much smaller than minimumShardSize. the shards include a
+// header with the globals, memory helpers, prototypes and inlined functions,
+// and the first shard also defines the globals and the memory
+void GenerateWasm2cShards(wasm::Module *module, const EmitPlan &plan, const std::string &outputFile, const Wasm2cOptions &options, FunctionCache *cache, DecompileStats *stats)
+{
+    constexpr size_t minimumShardSize = 256 << 10;
+
+    std::vector<CodeWriter> bodies;
+    bodies.reserve(plan.functions.size());
+    size_t totalSize = 0;
+    EmitWasm2cFunctions(module, plan, options, cache, stats, [&](EmittedFunction &emitted)
+                        {
+                            if (!plan.IsInlined(plan.functions[bodies.size()]))
+                                totalSize += emitted.body.Size();
+                            bodies.push_back(std::move(emitted.body));
+                        });
+
+    size_t shardCount = std::clamp<size_t>(totalSize / minimumShardSize, 1, options.shards);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < bodies.size(); i++)
+        if (!plan.IsInlined(plan.functions[i]))
+            order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [&](size_t left, size_t right)
+                     { return bodies[left].Size() > bodies[right].Size(); });
+
+    // (size, shard) of every shard, smallest on top
+    std::priority_queue<std::pair<size_t, size_t>, std::vector<std::pair<size_t, size_t>>, std::greater<>> shardSizes;
+    for (size_t shard = 0; shard < shardCount; shard++)
+        shardSizes.push({0, shard});
+
+    std::vector<std::vector<size_t>> shardFunctions(shardCount);
+    for (size_t index : order)
+    {
+        auto [size, shard] = shardSizes.top();
+        shardSizes.pop();
+        shardFunctions[shard].push_back(index);
+        shardSizes.push({size + bodies[index].Size(), shard});
+    }
+
+    std::filesystem::path outputPath = outputFile;
+    std::filesystem::path headerPath = std::filesystem::path(outputPath).replace_extension(".h");
+    {
+        FileOutputSink header(headerPath.string());
+        header.Write("#pragma once\n"
+                     "#include <stdint.h>\n");
+        if (plan.usesSimd)
+            header.Write("#include \"wasm2c_simd.h\"\n");
+        header.Write("\n");
+        GenerateWasm2cGlobals(module, plan, header, true, false);
+        GenerateWasm2cMemory(module, plan, header, options, true, false);
+        GenerateWasm2cData(module, plan, header, options, true, false);
+        GenerateWasm2cFunctionDeclarations(plan, header);
+        for (size_t i = 0; i < bodies.size(); i++)
+            if (plan.IsInlined(plan.functions[i]))
+                bodies[i].WriteTo(header);
+        GenerateWasm2cTable(module, plan, header, true, false);
+    }
+
+    for (size_t shard = 0; shard < shardCount; shard++)
+    {
+        std::filesystem::path shardPath = outputPath.parent_path() / (outputPath.stem().string() + "_" + std::to_string(shard) + outputPath.extension().string());
+        FileOutputSink sink(shardPath.string());
+
+        sink.Write("#include \"" + headerPath.filename().string() + "\"\n\n");
+        if (shard == 0)
+        {
+            GenerateWasm2cGlobals(module, plan, sink, false, true);
+            GenerateWasm2cMemory(module, plan, sink, options, false, true);
+            GenerateWasm2cData(module, plan, sink, options, false, true);
+            GenerateWasm2cTable(module, plan, sink, false, true);
+        }
+
+        // module order inside a shard keeps the output stable between runs
+        std::sort(shardFunctions[shard].begin(), shardFunctions[shard].end());
+        for (size_t index : shardFunctions[shard])
+        {
+            bodies[index].WriteTo(sink);
+            bodies[index] = CodeWriter();
+        }
+    }
+
+    Report("split ", order.size(), " functions (", totalSize, " bytes) over ", shardCount, " shards");
+}
+// plans and writes the C to outputFile, or to the output sink when there is
+// one, and the data segments to outputFile.data or the data sink. the
+// planning and the emission are recorded as phases of the stats, and with
+// --stats every emitted function too
+void WriteOutput(wasm::Module *module, const StreamedCodeSection *stream, const std::string &outputFile, const Wasm2cOptions &options, DecompileStats *stats = nullptr, OutputSink *output = nullptr, OutputSink *data = nullptr)
+{
+    PhaseClock planClock;
+    FunctionSummaries summaries(!options.keepDuplicates);
+    std::unique_ptr<wasm::Module> firstChunk;
+    if (stream != nullptr)
+        firstChunk = SummarizeStreamedFunctions(module, *stream, summaries);
+
+    EmitPlan plan = PlanWasm2c(module, stream, options, summaries);
+    plan.firstChunk = std::move(firstChunk);
+    plan.dataFile = outputFile + ".data";
+    plan.dataSink = data;
+    if (stats != nullptr)
+    {
+        planClock.Record(*stats, "plan");
+        stats->inlinedCallSites = plan.inlinedCallSites;
+    }
+
+    DecompileStats *functionStats = options.stats ? stats : nullptr;
+    auto generate = [&](FunctionCache *cache)
+    {
+        PhaseClock emitClock;
+        if (output != nullptr)
+            GenerateWasm2c(module, plan, *output, options, cache, functionStats);
+        else if (options.shards > 1)
+            GenerateWasm2cShards(module, plan, outputFile, options, cache, functionStats);
+        else
+        {
+            FileOutputSink sink(outputFile);
+            GenerateWasm2c(module, plan, sink, options, cache, functionStats);
+        }
+        if (stats != nullptr)
+            emitClock.Record(*stats, "emit");
+    };
+
+    if (options.cacheDirectory.empty())
+    {
+        generate(nullptr);
+        return;
+    }
+
+    // one cache file per output path, so batch runs writing outputs with the
+    // same file name into different directories do not share one
+    std::filesystem::path outputPath = std::filesystem::absolute(outputFile);
+    StableHasher pathHasher;
+    pathHasher.Add(outputPath.string());
+    char pathHash[17];
+    std::snprintf(pathHash, sizeof(pathHash), "%016llx", static_cast<unsigned long long>(pathHasher.Digest()));
+
+    std::filesystem::create_directories(options.cacheDirectory);
+    FunctionCache cache((std::filesystem::path(options.cacheDirectory) / (outputPath.filename().string() + "." + pathHash + ".cache")).string(), EmitterFingerprint(options));
+
+    generate(&cache);
+    cache.Commit();
+
+    size_t total = cache.Hits() + cache.Misses();
+    Report("function cache: reused ", cache.Hits(), " of ", total, " functions (", (total != 0 ? 100.0 * cache.Hits() / total : 0.0), "%)");
+}
+// runs the binaryen passes chosen with -O and --passes. with --time-passes
+// each pass gets a runner of its own so it can be timed, at the cost of no
+// longer running consecutive function passes together on each function
+void OptimizeWasm(wasm::Module *module, const std::string &inputFile, const Wasm2cOptions &options)
+{
+    bool pipeline = options.optimizeLevel > 0 || options.shrinkLevel > 0;
+    if (!pipeline && options.passes.empty())
+        return;
+
+    wasm::PassOptions passOptions;
+    passOptions.optimizeLevel = options.optimizeLevel;
+    passOptions.shrinkLevel = options.shrinkLevel;
+
+    wasm::PassRunner runner(module, passOptions);
+    if (pipeline)
+        runner.addDefaultOptimizationPasses();
+    for (const std::string &pass : options.passes)
+        runner.add(pass);
+
+    if (!options.timePasses)
+    {
+        runner.run();
+        return;
+    }
+
+    // reported in one piece so the reports of a batch do not interleave
+    std::ostringstream report;
+    report << "passes run on " << inputFile;
+    double totalSeconds = 0;
+    for (std::unique_ptr<wasm::Pass> &pass : runner.passes)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        wasm::PassRunner passRunner(module, passOptions);
+        passRunner.add(pass->name);
+        passRunner.run();
+        double seconds = SecondsSince(start);
+        totalSeconds += seconds;
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "\n  %-36s %8.3fs", pass->name.c_str(), seconds);
+        report << line;
+    }
+    char line[256];
+    std::snprintf(line, sizeof(line), "\n  %-36s %8.3fs", "total", totalSeconds);
+    report << line;
+    Report(report.str());
+}
+bool DecompileWasm2c(std::vector<char> binary, const std::string &name, const Wasm2cOptions &options, const Wasm2cCallbacks &callbacks, DecompileStats *stats)
+{
+    Diagnostics diagnostics(callbacks.diagnostic);
+    ScopedDiagnostics scope(callbacks.diagnostic ? &diagnostics : currentDiagnostics);
+
+    if (callbacks.output && options.shards > 1)
+    {
+        Report("the output callback receives a single file, it cannot be split into shards");
+        return false;
+    }
+    // the passes work on the whole module, while a stream only holds
+    // placeholder bodies between its chunks
+    if (options.stream && (options.optimizeLevel > 0 || options.shrinkLevel > 0 || !options.passes.empty()))
+    {
+        Report("streaming cannot be combined with optimization, --stream with -O or --passes");
+        return false;
+    }
+    // binaryen exits the process on a pass it does not know
+    std::vector<std::string> registeredPasses = wasm::PassRegistry::get()->getRegisteredNames();
+    for (const std::string &pass : options.passes)
+    {
+        if (std::find(registeredPasses.begin(), registeredPasses.end(), pass) == registeredPasses.end())
+        {
+            std::ostringstream message;
+            message << "unknown pass " << pass << ", the passes are:";
+            for (const std::string &name : registeredPasses)
+                message << "\n  " << name;
+            Report(message.str());
+            return false;
+        }
+    }
+
+    DecompileStats unusedStats;
+    if (stats == nullptr)
+        stats = &unusedStats;
+
+    try
+    {
+        PhaseClock phaseClock;
+        std::unique_ptr<StreamedCodeSection> stream;
+        std::unique_ptr<wasm::Module> module;
+        if (options.stream)
+        {
+            stream = std::make_unique<StreamedCodeSection>(std::move(binary), streamChunkBytes);
+            module.reset(stream->ParseSkeleton());
+        }
+        else
+        {
+            module.reset(ParseWasm(binary));
+            std::vector<char>().swap(binary);
+        }
+        phaseClock.Record(*stats, "parse");
+
+        phaseClock = PhaseClock();
+        OptimizeWasm(module.get(), name, options);
+        phaseClock.Record(*stats, "optimize");
+
+        std::optional<CallbackOutputSink> output;
+        std::optional<CallbackOutputSink> data;
+        if (callbacks.output)
+            output.emplace(callbacks.output);
+        if (callbacks.data)
+            data.emplace(callbacks.data);
+        WriteOutput(module.get(), stream.get(), name, options, stats, output ? &*output : nullptr, data ? &*data : nullptr);
+    }
+    catch (const std::runtime_error &)
+    {
+        // reported where it was thrown
+        return false;
+    }
+    catch (...)
+    {
+        // binaryen's parse errors
+        Report("could not decompile ", name);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// how linear memory is provided to the generated C
+enum class MemoryMode
+{
+    // no runtime, memory is a null pointer and the output does not run
+    None,
+    // the memory is a reserved region followed by guard pages, so out of
+    // bounds accesses fault without any check in the generated code
+    Guard,
+    // every access is checked against the current memory size
+    Bounds,
+    // addresses are masked into a power of two sized region
+    Mask,
+};
+// where the data segments of the module end up
+enum class DataMode
+{
+    // the data segments are not emitted
+    None,
+    // written to a .data file next to the output that is mapped at startup
+    File,
+    // written to a .data file that the assembler embeds with .incbin
+    Incbin,
+};
+struct Wasm2cOptions
+{
+    // threads emitting function bodies, 0 for one per core
+    size_t jobs = 1;
+    // directory of the per-function output cache, empty to disable it
+    std::string cacheDirectory;
+    // number of .c files the function bodies are split over, next to a
+    // shared header. 0 or 1 writes a single file
+    size_t shards = 1;
+    // only emit the functions reachable from this export
+    std::string entry;
+    // emit every function instead of only the reachable ones
+    bool keepUnreachable = false;
+    // emit functions identical to an earlier one in full rather than as a
+    // #define of it
+    bool keepDuplicates = false;
+    // functions of at most this many expressions that call no other
+    // function are emitted as static inline, 0 to inline none
+    size_t inlineBudget = 0;
+    MemoryMode memoryMode = MemoryMode::None;
+    DataMode dataMode = DataMode::None;
+    // binaryen optimization before emission, like wasm-opt's -O levels.
+    // passes run after the -O pipeline. a name binaryen does not know makes
+    // the decompilation fail
+    int optimizeLevel = 0;
+    int shrinkLevel = 0;
+    std::vector<std::string> passes;
+    bool timePasses = false;
+    // parse and emit the code section a chunk of functions at a time.
+    // cannot be combined with optimizeLevel, shrinkLevel or passes
+    bool stream = false;
+    // time every emitted function for --stats
+    bool stats = false;
+    // runtime call and branch counts ordering the functions hot first and
+    // annotating them, empty for none
+    std::string profileFile;
+};
+// the time every phase of a decompilation took, and with --stats how long
+// every function took to emit and how much C it came to
+struct DecompileStats
+{
+    struct Phase
+    {
+        const char *name;
+        double wallSeconds;
+        // cpu time of the whole process, so it includes the emitting
+        // threads and, in batch mode, the other files decompiled meanwhile
+        double cpuSeconds;
+    };
+    struct Function
+    {
+        std::string name;
+        double seconds;
+        size_t bytes;
+        // emitted as static inline
+        bool inlined;
+    };
+
+    std::vector<Phase> phases;
+    // in the order they were written
+    std::vector<Function> functions;
+    // calls and ref.funcs naming an inlined function
+    size_t inlinedCallSites = 0;
+
+    double WallSeconds(std::string_view name) const
+    {
+        double seconds = 0;
+        for (const Phase &phase : phases)
+            if (name == phase.name)
+                seconds += phase.wallSeconds;
+        return seconds;
+    }
+};
+double SecondsSince(std::chrono::steady_clock::time_point start);
+// how many threads to run for count items, with 0 jobs meaning one per core
+size_t ResolveJobCount(size_t jobs, size_t count);
+// wall and cpu time since it was made, recorded as a phase of the stats
+class PhaseClock
+{
+public:
+    void Record(DecompileStats &stats, const char *name) const
+    {
+        stats.phases.push_back({name, SecondsSince(wallStart), double(std::clock() - cpuStart) / CLOCKS_PER_SEC});
+    }
+
+private:
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+    std::clock_t cpuStart = std::clock();
+};
+// where the library hands the decompiled module to. the callbacks are only
+// called while DecompileWasm2c runs, one call at a time
+struct Wasm2cCallbacks
+{
+    // the C a piece at a time, in order. when empty the C is written to
+    // the file named by DecompileWasm2c's name, or split over shards
+    // next to it
+    std::function<void(std::string_view)> output;
+    // the .data file of DataMode::File and DataMode::Incbin. when empty it
+    // is written to the file name + ".data"
+    std::function<void(std::string_view)> data;
+    // every message, without a trailing newline. printed to stdout when
+    // empty
+    std::function<void(std::string_view)> diagnostic;
+};
+// decompiles the wasm binary. `name` is the output file the C refers to,
+// for the .data file and the function cache, whether or not the output goes
+// to a callback. returns false when the module cannot be decompiled, after
+// reporting why. several decompilations can run at once on different
+// threads, as long as they do not share output files
+bool DecompileWasm2c(std::vector<char> binary, const std::string &name, const Wasm2cOptions &options, const Wasm2cCallbacks &callbacks = {}, DecompileStats *stats = nullptr);